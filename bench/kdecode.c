@@ -0,0 +1,41 @@
+/*
+ * psxpad-spi.c's frame decode built for userspace
+ *
+ * Copyright (c) 2017 AZO
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License.
+ */
+
+#include "kshim.h"
+#include "kdecode.h"
+
+/* cut out of ../psxpad-spi.c by the Makefile, so this is the driver's code */
+#include "kdecode.inc"
+
+static struct input_dev kdecode_input;
+static struct psxpad_state kdecode_last[4];
+
+bool kdecode_decode(const uint8_t *rsp, unsigned int len, uint16_t *buttons)
+{
+	struct psxpad_state state;
+
+	if (!psxpad_mode_valid(rsp[1]) || psxpad_frame_len(rsp[1]) > len)
+		return false;
+	if (!psxpad_decode(rsp, len, &state))
+		return false;
+
+	*buttons = state.buttons;
+	return true;
+}
+
+bool kdecode_report(unsigned int port, const uint8_t *rsp, unsigned int len)
+{
+	return psxpad_report(&kdecode_input, &kdecode_last[port & 3], rsp, len);
+}
+
+unsigned long kdecode_events(void)
+{
+	return kdecode_input.events;
+}
@@ -0,0 +1,24 @@
+/*
+ * psxpad-spi.c's frame decode built for userspace (kdecode.c)
+ *
+ * Copyright (c) 2017 AZO
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License.
+ */
+
+#ifndef KDECODE_H
+#define KDECODE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* psxpad_mode_valid() and psxpad_frame_len() on the mode ID, then psxpad_decode() */
+bool kdecode_decode(const uint8_t *rsp, unsigned int len, uint16_t *buttons);
+/* psxpad_report() against the last state of one of 4 ports, true if it reported */
+bool kdecode_report(unsigned int port, const uint8_t *rsp, unsigned int len);
+/* input events psxpad_report() would have sent so far */
+unsigned long kdecode_events(void);
+
+#endif /* KDECODE_H */
@@ -0,0 +1,51 @@
+/*
+ * Just enough of the kernel for psxpad-spi.c's frame decode in userspace
+ *
+ * Copyright (c) 2017 AZO
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License.
+ */
+
+#ifndef KSHIM_H
+#define KSHIM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <linux/input.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+
+#define BIT(nr)			(1UL << (nr))
+#define ARRAY_SIZE(arr)		(sizeof(arr) / sizeof((arr)[0]))
+#define min_t(type, x, y)	((type)(x) < (type)(y) ? (type)(x) : (type)(y))
+
+#define for_each_set_bit(bit, addr, size)			\
+	for ((bit) = 0; (bit) < (size); (bit)++)		\
+		if (!(*(addr) & BIT(bit))) {} else
+
+/* sizeof(PSX_CMD_TAP_POLL) in the driver */
+#define PSXPAD_FRAME_MAX	35
+
+/* events are only counted */
+struct input_dev {
+	unsigned long events;
+};
+
+static inline void input_report_key(struct input_dev *dev, unsigned int code,
+				    int value)
+{
+	dev->events++;
+}
+
+static inline void input_report_abs(struct input_dev *dev, unsigned int code,
+				    int value)
+{
+	dev->events++;
+}
+
+#endif /* KSHIM_H */
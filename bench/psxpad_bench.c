@@ -0,0 +1,493 @@
+/*
+ * PSX(Play Station 1/2) pad benchmarks (using the libpsxpad emulator)
+ *
+ * Copyright (c) 2017 AZO
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License.
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/mman.h>
+
+/* the library's static bit swap and decode are timed directly */
+#include "../libpsxpad.c"
+#include "../libpsxpad_emu.h"
+#include "kdecode.h"
+
+/* what the emulated pads report, one frame and its successor per type */
+struct PSXPadBench_Type {
+	const char *strName;
+	int vType;
+	uint8_t bAnalog;	/* SetADMode() before polling */
+	uint8_t bPressure;	/* and SetPressure() */
+};
+
+static const struct PSXPadBench_Type ltPSXPadBenchType[] = {
+	{"digital",  PSXPADEMU_TYPE_DIGITAL,    0, 0},
+	{"analog",   PSXPADEMU_TYPE_DUALSHOCK,  1, 0},
+	{"pressure", PSXPADEMU_TYPE_DUALSHOCK2, 1, 1}
+};
+
+#define PSXPADBENCH_TYPE_NUM	(sizeof(ltPSXPadBenchType) / sizeof(ltPSXPadBenchType[0]))
+
+static const uint32_t lu32PSXPadBenchHz[] = {60, 250, 1000};
+
+static uint32_t u32Iterations = 1000000;
+static uint32_t u32Samples = 1000;
+static uint32_t u32BusHz = 125000;
+static uint32_t u32ByteGapUs;
+static volatile uint32_t u32Sink;	/* keeps results the compiler would drop */
+
+static uint64_t PSXPadBench_Now(void)
+{
+	struct timespec tNow;
+
+	clock_gettime(CLOCK_MONOTONIC, &tNow);
+	return (uint64_t)tNow.tv_sec * 1000000000 + tNow.tv_nsec;
+}
+
+static uint32_t PSXPadBench_Random(uint32_t *io_pu32Seed)
+{
+	*io_pu32Seed = *io_pu32Seed * 1103515245 + 12345;
+	return *io_pu32Seed >> 8;
+}
+
+/* one emulated pad of a type, configured as spidev_psxpad would, its first frame polled */
+static struct PSXPads *PSXPadBench_Open(const struct PSXPadBench_Type *i_ptType, struct PSXPadEmu **o_pptEmu)
+{
+	struct PSXPad_PackedState tState;
+	struct PSXPads *ptPSXPads;
+	struct PSXPadEmu *ptEmu;
+
+	ptEmu = PSXPadEmu_Create(1);
+	if (!ptEmu || PSXPadEmu_Plug(ptEmu, 0, 0, i_ptType->vType) < 0)
+		goto err;
+	ptPSXPads = PSXPads_InitEmu(ptEmu);
+	if (!ptPSXPads)
+		goto err;
+
+	memset(&tState, 0, sizeof(tState));
+	tState.u16Buttons = PSXPAD_BUTTON_CRS | PSXPAD_BUTTON_R1;
+	memset(tState.lu8Axis, 0x80, sizeof(tState.lu8Axis));
+	memset(tState.lu8Pressure, 0x40, sizeof(tState.lu8Pressure));
+	PSXPadEmu_SetState(ptEmu, 0, 0, &tState);
+
+	if ((i_ptType->bAnalog && PSXPads_SetADMode(ptPSXPads, 0, 1, 1) < 0) || (i_ptType->bPressure && PSXPads_SetPressure(ptPSXPads, 0, 1) < 0) || PSXPads_DetectMultitap(ptPSXPads, 0) < 0 || PSXPads_Pool(ptPSXPads) < 0) {
+		PSXPads_Uninit(ptPSXPads);
+		goto err;
+	}
+
+	*o_pptEmu = ptEmu;
+	return ptPSXPads;
+
+err:
+	perror("can't set up the emulated pad");
+	exit(1);
+}
+
+static void PSXPadBench_Close(struct PSXPads *ptPSXPads, struct PSXPadEmu *ptEmu)
+{
+	PSXPads_Uninit(ptPSXPads);
+	PSXPadEmu_Destroy(ptEmu);
+}
+
+static void PSXPadBench_Print(const char i_strName[], const uint64_t i_u64Ns, const uint32_t i_u32Num)
+{
+	printf("  %-34s %10.1f ns %12.0f /s\n", i_strName, (double)i_u64Ns / i_u32Num, i_u32Num * 1e9 / i_u64Ns);
+}
+
+/* bit swap of a MSB-first controller, and each decoder on frames of each type */
+static void PSXPadBench_Decode(void)
+{
+	struct PSXPad_KeyState tKeyState;
+	struct PSXPad_PackedState tState;
+	struct PSXPads *ptPSXPads;
+	struct PSXPadEmu *ptEmu;
+	struct PSXPad *ptPad;
+	uint8_t lu8Wire[PSXPAD_FRAME_MAX], lu8Frame[2][PSXPAD_FRAME_MAX];
+	uint8_t u8Len;
+	uint16_t u16Buttons = 0;
+	uint64_t u64Start;
+	uint32_t u32Num;
+	char strName[64];
+	int i;
+
+	printf("decode (%u iterations)\n", u32Iterations);
+
+	memset(lu8Wire, 0xA5, sizeof(lu8Wire));
+	u64Start = PSXPadBench_Now();
+	for (u32Num = 0; u32Num < u32Iterations; u32Num++) {
+		PSXPads_ReverseBits(lu8Wire, lu8Wire, sizeof(lu8Wire));
+		u32Sink += lu8Wire[u32Num % sizeof(lu8Wire)];
+	}
+	PSXPadBench_Print("bit swap, 35 bytes", PSXPadBench_Now() - u64Start, u32Iterations);
+
+	for (i = 0; i < PSXPADBENCH_TYPE_NUM; i++) {
+		ptPSXPads = PSXPadBench_Open(&ltPSXPadBenchType[i], &ptEmu);
+		ptPad = &(ptPSXPads->ltPad[0]);
+		u8Len = ptPad->u8PoolLen;
+
+		/* the same frame and one with the buttons and sticks moved */
+		memcpy(lu8Frame[0], ptPad->lu8Response, u8Len);
+		memcpy(lu8Frame[1], ptPad->lu8Response, u8Len);
+		lu8Frame[1][3] ^= 0x5A;
+		for (u32Num = 5; u32Num < u8Len; u32Num++)
+			lu8Frame[1][u32Num] ^= 0x21;
+		PSXPads_ReverseBits(lu8Wire, lu8Frame[0], u8Len);
+
+		u64Start = PSXPadBench_Now();
+		for (u32Num = 0; u32Num < u32Iterations; u32Num++) {
+			PSXPads_GetKeyState(ptPSXPads, 0, &tKeyState);
+			u32Sink += tKeyState.bCrs;
+		}
+		snprintf(strName, sizeof(strName), "GetKeyState, %s", ltPSXPadBenchType[i].strName);
+		PSXPadBench_Print(strName, PSXPadBench_Now() - u64Start, u32Iterations);
+
+		u64Start = PSXPadBench_Now();
+		for (u32Num = 0; u32Num < u32Iterations; u32Num++) {
+			PSXPads_ReverseBits(ptPad->lu8Response, lu8Wire, u8Len);
+			PSXPads_GetKeyState(ptPSXPads, 0, &tKeyState);
+			u32Sink += tKeyState.bCrs;
+		}
+		snprintf(strName, sizeof(strName), "swap + GetKeyState, %s", ltPSXPadBenchType[i].strName);
+		PSXPadBench_Print(strName, PSXPadBench_Now() - u64Start, u32Iterations);
+
+		u64Start = PSXPadBench_Now();
+		for (u32Num = 0; u32Num < u32Iterations; u32Num++) {
+			PSXPads_GetPackedState(ptPSXPads, 0, 0, &tState);
+			u32Sink += tState.u16Buttons;
+		}
+		snprintf(strName, sizeof(strName), "GetPackedState, %s", ltPSXPadBenchType[i].strName);
+		PSXPadBench_Print(strName, PSXPadBench_Now() - u64Start, u32Iterations);
+
+		u64Start = PSXPadBench_Now();
+		for (u32Num = 0; u32Num < u32Iterations; u32Num++) {
+			kdecode_decode(lu8Frame[u32Num & 1], u8Len, &u16Buttons);
+			u32Sink += u16Buttons;
+		}
+		snprintf(strName, sizeof(strName), "psxpad-spi decode, %s", ltPSXPadBenchType[i].strName);
+		PSXPadBench_Print(strName, PSXPadBench_Now() - u64Start, u32Iterations);
+
+		u64Start = PSXPadBench_Now();
+		for (u32Num = 0; u32Num < u32Iterations; u32Num++)
+			u32Sink += kdecode_report(0, lu8Frame[0], u8Len);
+		snprintf(strName, sizeof(strName), "psxpad-spi report same, %s", ltPSXPadBenchType[i].strName);
+		PSXPadBench_Print(strName, PSXPadBench_Now() - u64Start, u32Iterations);
+
+		u64Start = PSXPadBench_Now();
+		for (u32Num = 0; u32Num < u32Iterations; u32Num++)
+			u32Sink += kdecode_report(0, lu8Frame[u32Num & 1], u8Len);
+		snprintf(strName, sizeof(strName), "psxpad-spi report changed, %s", ltPSXPadBenchType[i].strName);
+		PSXPadBench_Print(strName, PSXPadBench_Now() - u64Start, u32Iterations);
+
+		PSXPadBench_Close(ptPSXPads, ptEmu);
+	}
+	u32Sink += kdecode_events();
+}
+
+/*
+ * a poll as libpsxpad does it, as long as the last frame (variable), against
+ * always clocking the full 21 bytes of PSX_CMD_POLL (fixed); both go through
+ * PSXPads_Pool(), fixed pins the frame length back to 21 before each one.
+ * CPU time with an instant bus, wall time with the bus at its clock
+ */
+static void PSXPadBench_Poll(void)
+{
+	struct PSXPads *ptPSXPads;
+	struct PSXPadEmu *ptEmu;
+	uint64_t u64Start, u64Bytes, u64Bytes0;
+	uint64_t lu64Ns[2][2], lu64Bytes[2];
+	uint32_t u32Num, u32Wire;
+	uint8_t u8PadNo;
+	int i, iBus;
+
+	/* a frame takes ~1ms on the wire, fewer of them */
+	u32Wire = u32Iterations / 1000 ? u32Iterations / 1000 : 1;
+
+	printf("poll, variable vs fixed length (%u iterations, %u on a %u Hz bus)\n", u32Iterations, u32Wire, u32BusHz);
+	printf("  %-10s %14s %14s %14s %14s %8s %8s\n", "pad", "var cpu ns", "fixed cpu ns", "var wire us", "fixed wire us", "var B", "fixed B");
+
+	for (i = 0; i < PSXPADBENCH_TYPE_NUM; i++) {
+		ptPSXPads = PSXPadBench_Open(&ltPSXPadBenchType[i], &ptEmu);
+
+		for (iBus = 0; iBus < 2 && (iBus == 0 || u32BusHz); iBus++) {
+			PSXPadEmu_SetBusSpeed(ptEmu, iBus ? u32BusHz : 0, u32ByteGapUs);
+
+			PSXPadEmu_GetStats(ptEmu, NULL, &u64Bytes0);
+			u64Start = PSXPadBench_Now();
+			for (u32Num = 0; u32Num < (iBus ? u32Wire : u32Iterations); u32Num++)
+				PSXPads_Pool(ptPSXPads);
+			lu64Ns[iBus][0] = PSXPadBench_Now() - u64Start;
+			PSXPadEmu_GetStats(ptEmu, NULL, &u64Bytes);
+			lu64Bytes[0] = (u64Bytes - u64Bytes0) / (iBus ? u32Wire : u32Iterations);
+
+			PSXPadEmu_GetStats(ptEmu, NULL, &u64Bytes0);
+			u64Start = PSXPadBench_Now();
+			for (u32Num = 0; u32Num < (iBus ? u32Wire : u32Iterations); u32Num++) {
+				for (u8PadNo = 0; u8PadNo < ptPSXPads->u8PadsNum; u8PadNo++)
+					ptPSXPads->ltPad[u8PadNo].u8PoolLen = sizeof(PSX_CMD_POLL);
+				PSXPads_Pool(ptPSXPads);
+			}
+			lu64Ns[iBus][1] = PSXPadBench_Now() - u64Start;
+			PSXPadEmu_GetStats(ptEmu, NULL, &u64Bytes);
+			lu64Bytes[1] = (u64Bytes - u64Bytes0) / (iBus ? u32Wire : u32Iterations);
+		}
+		if (!u32BusHz)
+			lu64Ns[1][0] = lu64Ns[1][1] = 0;
+
+		printf("  %-10s %14.1f %14.1f %14.1f %14.1f %8lu %8lu\n", ltPSXPadBenchType[i].strName,
+		       (double)lu64Ns[0][0] / u32Iterations, (double)lu64Ns[0][1] / u32Iterations,
+		       lu64Ns[1][0] / 1e3 / u32Wire, lu64Ns[1][1] / 1e3 / u32Wire,
+		       (unsigned long)lu64Bytes[0], (unsigned long)lu64Bytes[1]);
+
+		PSXPadBench_Close(ptPSXPads, ptEmu);
+	}
+}
+
+/* the enter config, 0x44, exit config sequence of SetADMode(), 3 transfers */
+static void PSXPadBench_Config(void)
+{
+	struct PSXPads *ptPSXPads;
+	struct PSXPadEmu *ptEmu;
+	uint64_t u64Start, u64Ns, u64WireNs = 0;
+	uint64_t u64Transfers, u64Bytes, u64Transfers0, u64Bytes0;
+	uint32_t u32Num, u32Wire;
+
+	u32Wire = u32Iterations / 10000 ? u32Iterations / 10000 : 1;
+	ptPSXPads = PSXPadBench_Open(&ltPSXPadBenchType[PSXPADBENCH_TYPE_NUM - 1], &ptEmu);
+
+	PSXPadEmu_GetStats(ptEmu, &u64Transfers0, &u64Bytes0);
+	u64Start = PSXPadBench_Now();
+	for (u32Num = 0; u32Num < u32Iterations; u32Num++)
+		PSXPads_SetADMode(ptPSXPads, 0, 1, 1);
+	u64Ns = PSXPadBench_Now() - u64Start;
+	PSXPadEmu_GetStats(ptEmu, &u64Transfers, &u64Bytes);
+
+	if (u32BusHz) {
+		PSXPadEmu_SetBusSpeed(ptEmu, u32BusHz, u32ByteGapUs);
+		u64Start = PSXPadBench_Now();
+		for (u32Num = 0; u32Num < u32Wire; u32Num++)
+			PSXPads_SetADMode(ptPSXPads, 0, 1, 1);
+		u64WireNs = PSXPadBench_Now() - u64Start;
+	}
+
+	printf("SetADMode, pressure pad (%u iterations, %u on a %u Hz bus)\n", u32Iterations, u32Wire, u32BusHz);
+	printf("  %lu transfers, %lu bytes each; %.1f ns cpu, %.1f us on the bus\n",
+	       (unsigned long)((u64Transfers - u64Transfers0) / u32Iterations), (unsigned long)((u64Bytes - u64Bytes0) / u32Iterations),
+	       (double)u64Ns / u32Iterations, u64WireNs / 1e3 / u32Wire);
+
+	PSXPadBench_Close(ptPSXPads, ptEmu);
+}
+
+/*
+ * the cross button toggles at random times; the emulated pad picks a toggle
+ * up when it samples. sample is from that latch to the callback, input from
+ * the toggle itself, so it adds the wait for the next poll.
+ */
+struct PSXPadBench_Latency {
+	struct PSXPad_PackedState tState;
+	uint64_t u64IntervalNs;
+	uint64_t u64NextNs;	/* the next toggle */
+	uint64_t u64ToggleNs;	/* the toggle not seen yet, 0 none */
+	uint64_t u64SampleNs;	/* when the pad latched it */
+	uint64_t *lu64Sample;
+	uint64_t *lu64Input;
+	uint32_t u32Num;
+	uint32_t u32Seed;
+};
+
+static void PSXPadBench_Sample(struct PSXPadEmu *ptEmu, const uint8_t u8PadNo, const uint8_t u8Port, void *pvUser)
+{
+	struct PSXPadBench_Latency *ptLatency = pvUser;
+	uint64_t u64Now = PSXPadBench_Now();
+
+	if (ptLatency->u64ToggleNs || u64Now < ptLatency->u64NextNs)
+		return;
+
+	ptLatency->tState.u16Buttons ^= PSXPAD_BUTTON_CRS;
+	PSXPadEmu_SetState(ptEmu, u8PadNo, u8Port, &(ptLatency->tState));
+	ptLatency->u64ToggleNs = ptLatency->u64NextNs;
+	ptLatency->u64SampleNs = u64Now;
+}
+
+static void PSXPadBench_Changed(struct PSXPads *ptPSXPads, const uint8_t u8PadNo, const uint8_t u8Port, const struct PSXPad_PackedState *ptState, void *pvUser)
+{
+	struct PSXPadBench_Latency *ptLatency = pvUser;
+	uint64_t u64Now = PSXPadBench_Now();
+
+	if (!ptLatency->u64ToggleNs || ptState->u16Buttons != ptLatency->tState.u16Buttons)
+		return;
+
+	ptLatency->lu64Sample[ptLatency->u32Num] = u64Now - ptLatency->u64SampleNs;
+	ptLatency->lu64Input[ptLatency->u32Num++] = u64Now - ptLatency->u64ToggleNs;
+	ptLatency->u64ToggleNs = 0;
+	/* anywhere in the next two poll intervals, so toggles fall at every phase */
+	ptLatency->u64NextNs = u64Now + PSXPadBench_Random(&(ptLatency->u32Seed)) % (2 * ptLatency->u64IntervalNs);
+
+	if (ptLatency->u32Num == u32Samples)
+		PSXPads_Stop(ptPSXPads);
+}
+
+static int PSXPadBench_Compare(const void *pvA, const void *pvB)
+{
+	const uint64_t *pu64A = pvA, *pu64B = pvB;
+
+	return (*pu64A > *pu64B) - (*pu64A < *pu64B);
+}
+
+static double PSXPadBench_Percentile(const uint64_t i_lu64Sorted[], const uint32_t i_u32Num, const uint32_t i_u32PerMille)
+{
+	uint32_t u32Loc = (uint64_t)i_u32Num * i_u32PerMille / 1000;
+
+	if (u32Loc >= i_u32Num)
+		u32Loc = i_u32Num - 1;
+
+	return i_lu64Sorted[u32Loc] / 1e3;
+}
+
+static void PSXPadBench_PrintLatency(const uint32_t i_u32Hz, const char i_strFrom[], uint64_t io_lu64Sample[], const uint32_t i_u32Num)
+{
+	uint64_t u64Sum = 0;
+	uint32_t u32Num;
+
+	for (u32Num = 0; u32Num < i_u32Num; u32Num++)
+		u64Sum += io_lu64Sample[u32Num];
+	qsort(io_lu64Sample, i_u32Num, sizeof(io_lu64Sample[0]), PSXPadBench_Compare);
+
+	printf("  %4u Hz %-6s %10.1f %10.1f %10.1f %10.1f %10.1f\n", i_u32Hz, i_strFrom,
+	       PSXPadBench_Percentile(io_lu64Sample, i_u32Num, 500), PSXPadBench_Percentile(io_lu64Sample, i_u32Num, 990),
+	       PSXPadBench_Percentile(io_lu64Sample, i_u32Num, 999), io_lu64Sample[i_u32Num - 1] / 1e3, u64Sum / 1e3 / i_u32Num);
+}
+
+/* through the timerfd loop of PSXPads_Run(), as spidev_psxpad polls */
+static void PSXPadBench_Latency(void)
+{
+	struct PSXPadBench_Latency tLatency;
+	struct PSXPads *ptPSXPads;
+	struct PSXPadEmu *ptEmu;
+	int i;
+
+	printf("sample to callback latency, analog pad (%u samples, %u Hz bus)\n", u32Samples, u32BusHz);
+	printf("  %-14s %10s %10s %10s %10s %10s\n", "rate   from", "p50 us", "p99 us", "p999 us", "max us", "mean us");
+
+	memset(&tLatency, 0, sizeof(tLatency));
+	tLatency.lu64Sample = calloc(u32Samples, sizeof(tLatency.lu64Sample[0]));
+	tLatency.lu64Input = calloc(u32Samples, sizeof(tLatency.lu64Input[0]));
+	if (!tLatency.lu64Sample || !tLatency.lu64Input) {
+		perror("can't allocate samples");
+		exit(1);
+	}
+	tLatency.u32Seed = 1;
+	memset(tLatency.tState.lu8Axis, 0x80, sizeof(tLatency.tState.lu8Axis));
+
+	for (i = 0; i < sizeof(lu32PSXPadBenchHz) / sizeof(lu32PSXPadBenchHz[0]); i++) {
+		ptPSXPads = PSXPadBench_Open(&ltPSXPadBenchType[1], &ptEmu);
+		PSXPadEmu_SetState(ptEmu, 0, 0, &(tLatency.tState));
+		PSXPadEmu_SetBusSpeed(ptEmu, u32BusHz, u32ByteGapUs);
+		PSXPadEmu_SetSampleHook(ptEmu, PSXPadBench_Sample, &tLatency);
+
+		tLatency.u64IntervalNs = 1000000000 / lu32PSXPadBenchHz[i];
+		tLatency.u64NextNs = PSXPadBench_Now();
+		tLatency.u64ToggleNs = 0;
+		tLatency.u32Num = 0;
+		PSXPads_SetPoolInterval(ptPSXPads, 1000000 / lu32PSXPadBenchHz[i]);
+		PSXPads_SetIdleTimeout(ptPSXPads, 0);
+		PSXPads_SetCallback(ptPSXPads, PSXPadBench_Changed, &tLatency);
+		if (PSXPads_Run(ptPSXPads) < 0) {
+			perror("can't poll the emulated pad");
+			exit(1);
+		}
+
+		PSXPadBench_PrintLatency(lu32PSXPadBenchHz[i], "sample", tLatency.lu64Sample, tLatency.u32Num);
+		PSXPadBench_PrintLatency(lu32PSXPadBenchHz[i], "input", tLatency.lu64Input, tLatency.u32Num);
+
+		PSXPadBench_Close(ptPSXPads, ptEmu);
+	}
+
+	free(tLatency.lu64Sample);
+	free(tLatency.lu64Input);
+}
+
+static void print_usage(const char prog[])
+{
+	printf("Usage: %s [-inbgpL]\n", prog);
+	puts("  -i --iterations  iterations of the decode, poll and config loops (default 1000000)\n"
+	     "  -n --samples     latency samples per poll rate (default 1000)\n"
+	     "  -b --bus         emulated SPI clock in Hz, 0 an instant bus (default 125000)\n"
+	     "  -g --gap         emulated gap after each byte in us, the ACK pulse (default 0)\n"
+	     "  -p --priority    SCHED_FIFO priority, 0 keeps SCHED_OTHER (default 0)\n"
+	     "  -L --no-latency  skip the latency runs, they take about a minute\n");
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	static const struct option ltOption[] = {
+		{"iterations", 1, 0, 'i'},
+		{"samples",    1, 0, 'n'},
+		{"bus",        1, 0, 'b'},
+		{"gap",        1, 0, 'g'},
+		{"priority",   1, 0, 'p'},
+		{"no-latency", 0, 0, 'L'},
+		{NULL,         0, 0, 0}
+	};
+	struct sched_param tParam;
+	int iPriority = 0;
+	uint8_t bLatency = 1;
+	int c;
+
+	while ((c = getopt_long(argc, argv, "i:n:b:g:p:L", ltOption, NULL)) != -1) {
+		switch (c) {
+		case 'i':
+			u32Iterations = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			u32Samples = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			u32BusHz = strtoul(optarg, NULL, 0);
+			break;
+		case 'g':
+			u32ByteGapUs = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			iPriority = atoi(optarg);
+			break;
+		case 'L':
+			bLatency = 0;
+			break;
+		default:
+			print_usage(argv[0]);
+			break;
+		}
+	}
+	if (u32Iterations == 0 || u32Samples == 0)
+		print_usage(argv[0]);
+
+	/* the latency tails are the scheduler's as much as the code's */
+	if (iPriority > 0) {
+		memset(&tParam, 0, sizeof(tParam));
+		tParam.sched_priority = iPriority;
+		if (sched_setscheduler(0, SCHED_FIFO, &tParam) < 0)
+			perror("can't set SCHED_FIFO");
+		if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+			perror("can't lock memory");
+	}
+
+	PSXPadBench_Decode();
+	PSXPadBench_Poll();
+	PSXPadBench_Config();
+	if (bLatency)
+		PSXPadBench_Latency();
+
+	return 0;
+}
@@ -0,0 +1,1213 @@
+/*
+ * PSX(Play Station 1/2) pad library (using spidev driver)
+ *
+ * Copyright (c) 2017 AZO
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <linux/types.h>
+#include <linux/spi/spidev.h>
+
+#include "libpsxpad.h"
+#include "libpsxpad_trace.h"
+
+#if PSXPAD_MAXPADNUM == 0 || PSXPAD_MAXPADNUM > 8
+#error PSXPAD_MAXPADNUM must be 1-8
+#endif
+
+static const uint8_t PSX_CMD_INIT_PRESSURE[]	= {0x01, 0x40, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00};
+static const uint8_t PSX_CMD_POLL[]		= {0x01, 0x42, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+static const uint8_t PSX_CMD_ENTER_CFG[]	= {0x01, 0x43, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00};
+static const uint8_t PSX_CMD_EXIT_CFG[]		= {0x01, 0x43, 0x00, 0x00, 0x5A, 0x5A, 0x5A, 0x5A, 0x5A};
+static const uint8_t PSX_CMD_ENABLE_MOTOR[]	= {0x01, 0x4D, 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+static const uint8_t PSX_CMD_ALL_PRESSURE[]	= {0x01, 0x4F, 0x00, 0xFF, 0xFF, 0x03, 0x00, 0x00, 0x00};
+static const uint8_t PSX_CMD_AD_MODE[]		= {0x01, 0x44, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00};
+/* multitap (SCPH-1070) answers ID 0x80 and 4 slots of ID, 0x5A, 6 data bytes */
+static const uint8_t PSX_CMD_TAP_POLL[]		= {0x01, 0x42, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+
+#define PSXPAD_FRAME_MAX	sizeof(PSX_CMD_TAP_POLL)
+#define PSXPAD_TAP_SLOT_LEN	8
+
+/* idle back-off: full rate, two idle steps after the timeout, hot-plug rate while no pad answers */
+#define PSXPAD_POOL_INTERVAL_US		16666
+/* as poll-interval-us of psxpad-spi */
+#define PSXPAD_POOL_INTERVAL_US_MIN	1000
+#define PSXPAD_POOL_INTERVAL_US_MAX	32000
+#define PSXPAD_IDLE_TIMEOUT_MS		3000
+#define PSXPAD_IDLE_INTERVAL_US		50000
+#define PSXPAD_IDLE_INTERVAL2_US	100000
+#define PSXPAD_HOTPLUG_INTERVAL_US	250000
+
+struct PSXPad {
+	uint8_t lu8PoolCmd[PSXPAD_FRAME_MAX];	/* in wire order, sent as is */
+	uint8_t lu8Response[PSXPAD_FRAME_MAX];
+	uint8_t lu8LastResponse[PSXPAD_FRAME_MAX];
+	uint8_t u8PoolLen;
+	uint8_t bMSBFirst;	/* the transport shifts this pad MSB first */
+	uint8_t bPresent;
+	uint8_t u8Changed;	/* bit per multitap port, bit 0 alone without one */
+	uint8_t bMultitap;
+	uint8_t u8AttPinNo;
+	uint8_t bAnalog;
+	uint8_t bLock;
+	uint8_t bMotor1Enable;
+	uint8_t bMotor2Enable;
+	uint8_t u8Motor1Level;
+	uint8_t u8Motor2Level;
+	uint8_t lu8EnableMotor[sizeof(PSX_CMD_ENABLE_MOTOR)];
+	uint8_t lu8ADMode[sizeof(PSX_CMD_AD_MODE)];
+};
+
+/*
+ * spidev transport of PSXPads_Init(); a spidev device is one chip select,
+ * so each pad has its own and is clocked by a message of its own
+ */
+struct PSXPads_SPI {
+	int liFD[PSXPAD_MAXPADNUM];
+	uint8_t lbLSBFirst[PSXPAD_MAXPADNUM];
+	uint8_t u8PadsNum;
+	struct spi_ioc_transfer tTransfer;
+};
+
+struct PSXPads {
+	const struct PSXPads_Transport *ptTransport;	/* NULL when replaying */
+	void *pvTransport;
+	uint8_t u8PadsNum;
+	uint8_t u8PoolFirst;
+	uint32_t u32PoolIntervalUs;
+	uint32_t u32IdleTimeoutMs;
+	struct timespec tLastChange;
+	/* event loop */
+	int iTimerFD;
+	struct timespec tDeadline;
+	PSXPads_Callback fnCallback;
+	void *pvUser;
+	volatile int bStop;
+	/* record every cycle to a trace, or poll from one instead of a transport */
+	struct PSXPadTrace *ptRecord;
+	struct PSXPadTrace *ptReplay;
+	uint8_t bReplayRealTime;
+	struct timespec tReplayBase;
+	uint64_t u64ReplayFirstNs;
+	struct PSXPad ltPad[PSXPAD_MAXPADNUM];
+};
+
+/* PSX pad is LSB first, this table swaps bit order when spidev can't */
+#define REVERSE_BIT_R2(n) (n), (n) + 2 * 64, (n) + 1 * 64, (n) + 3 * 64
+#define REVERSE_BIT_R4(n) REVERSE_BIT_R2(n), REVERSE_BIT_R2((n) + 2 * 16), REVERSE_BIT_R2((n) + 1 * 16), REVERSE_BIT_R2((n) + 3 * 16)
+#define REVERSE_BIT_R6(n) REVERSE_BIT_R4(n), REVERSE_BIT_R4((n) + 2 * 4), REVERSE_BIT_R4((n) + 1 * 4), REVERSE_BIT_R4((n) + 3 * 4)
+static const uint8_t lu8ReverseBit[0x100] = {
+	REVERSE_BIT_R6(0), REVERSE_BIT_R6(2), REVERSE_BIT_R6(1), REVERSE_BIT_R6(3)
+};
+
+static int PSXPads_CheckPad(const struct PSXPads *ptPSXPads, const uint8_t u8PadNo)
+{
+	if (!ptPSXPads || u8PadNo >= ptPSXPads->u8PadsNum) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return 0;
+}
+
+static int PSXPads_SPIInit(int i_iFD, struct spi_ioc_transfer *o_ptTransfer, uint8_t i_u8Mode, uint8_t i_u8Bits, uint32_t i_u32Speed, const uint16_t i_u16Delay)
+{
+	/*
+	 * spi mode
+	 */
+	if (ioctl(i_iFD, SPI_IOC_WR_MODE, &i_u8Mode) == -1)
+		return -1;
+	if (ioctl(i_iFD, SPI_IOC_RD_MODE, &i_u8Mode) == -1)
+		return -1;
+
+	/*
+	 * bits per word
+	 */
+	if (ioctl(i_iFD, SPI_IOC_WR_BITS_PER_WORD, &i_u8Bits) == -1)
+		return -1;
+	if (ioctl(i_iFD, SPI_IOC_RD_BITS_PER_WORD, &i_u8Bits) == -1)
+		return -1;
+
+	/*
+	 * max speed hz
+	 */
+	if (ioctl(i_iFD, SPI_IOC_WR_MAX_SPEED_HZ, &i_u32Speed) == -1)
+		return -1;
+	if (ioctl(i_iFD, SPI_IOC_RD_MAX_SPEED_HZ, &i_u32Speed) == -1)
+		return -1;
+
+	/* set transfer settings */
+	memset(o_ptTransfer, 0, sizeof(*o_ptTransfer));
+	o_ptTransfer->delay_usecs = i_u16Delay;
+	o_ptTransfer->speed_hz = i_u32Speed;
+	o_ptTransfer->bits_per_word = i_u8Bits;
+
+	return 0;
+}
+
+static void PSXPads_ReverseBits(uint8_t o_lu8Buf[], const uint8_t i_lu8Buf[], const uint8_t i_u8Len)
+{
+	uint8_t u8Loc;
+
+	for (u8Loc = 0; u8Loc < i_u8Len; u8Loc++)
+		o_lu8Buf[u8Loc] = lu8ReverseBit[i_lu8Buf[u8Loc]];
+}
+
+static int PSXPads_SPITransfer(void *pvCtx, const uint8_t u8PadNo, const uint8_t i_lu8Send[], uint8_t o_lu8Response[], const uint8_t i_u8Len)
+{
+	struct PSXPads_SPI *ptSPI = pvCtx;
+
+	if (u8PadNo >= ptSPI->u8PadsNum) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* set transfer settings, attention is released at the end */
+	ptSPI->tTransfer.tx_buf		= (unsigned long)i_lu8Send;
+	ptSPI->tTransfer.rx_buf		= (unsigned long)o_lu8Response;
+	ptSPI->tTransfer.len		= i_u8Len;
+	ptSPI->tTransfer.cs_change	= 0;
+
+	if (ioctl(ptSPI->liFD[u8PadNo], SPI_IOC_MESSAGE(1), &(ptSPI->tTransfer)) < 1)
+		return -1;
+
+	if (!ptSPI->lbLSBFirst[u8PadNo])
+		PSXPads_ReverseBits(o_lu8Response, o_lu8Response, i_u8Len);
+
+	return 0;
+}
+
+static uint8_t PSXPads_SPIMSBFirst(void *pvCtx, const uint8_t u8PadNo)
+{
+	struct PSXPads_SPI *ptSPI = pvCtx;
+
+	return ptSPI->lbLSBFirst[u8PadNo] ? 0 : 1;
+}
+
+static void PSXPads_SPIClose(void *pvCtx)
+{
+	struct PSXPads_SPI *ptSPI = pvCtx;
+	uint8_t u8PadNo;
+
+	for (u8PadNo = 0; u8PadNo < PSXPAD_MAXPADNUM; u8PadNo++)
+		if (ptSPI->liFD[u8PadNo] >= 0)
+			close(ptSPI->liFD[u8PadNo]);
+	free(ptSPI);
+}
+
+/* no fnPoll, a message can't span chip selects; the pads are polled one by one */
+static const struct PSXPads_Transport tPSXPads_SPI = {
+	.fnTransfer	= PSXPads_SPITransfer,
+	.fnClose	= PSXPads_SPIClose,
+	.fnMSBFirst	= PSXPads_SPIMSBFirst
+};
+
+/* /dev/spidevB.C is pad 0, pad n is the chip select n above it on the same bus */
+static int PSXPads_SPIDevice(char o_strDevice[], const size_t i_sizeDevice, const char i_strDevice[], const uint8_t u8PadNo)
+{
+	const char *pcDot;
+	char *pcEnd;
+	unsigned long ulCS;
+
+	if (u8PadNo == 0) {
+		if (strlen(i_strDevice) >= i_sizeDevice)
+			goto err;
+		strcpy(o_strDevice, i_strDevice);
+		return 0;
+	}
+
+	pcDot = strrchr(i_strDevice, '.');
+	if (!pcDot || pcDot[1] < '0' || pcDot[1] > '9')
+		goto err;
+	ulCS = strtoul(pcDot + 1, &pcEnd, 10);
+	if (*pcEnd)
+		goto err;
+	if ((size_t)snprintf(o_strDevice, i_sizeDevice, "%.*s.%lu", (int)(pcDot - i_strDevice), i_strDevice, ulCS + u8PadNo) >= i_sizeDevice)
+		goto err;
+
+	return 0;
+
+err:
+	errno = EINVAL;
+	return -1;
+}
+
+/* the parts of init a transport and a replay handle share */
+static int PSXPads_Setup(struct PSXPads *ptPSXPads, const uint8_t i_u8PadNum)
+{
+	struct itimerspec tTimer;
+	uint8_t u8PadNo, u8Loc;
+
+	/* first deadline is now, the loop polls right away */
+	ptPSXPads->iTimerFD = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (ptPSXPads->iTimerFD < 0)
+		return -1;
+	clock_gettime(CLOCK_MONOTONIC, &(ptPSXPads->tDeadline));
+	memset(&tTimer, 0, sizeof(tTimer));
+	tTimer.it_value = ptPSXPads->tDeadline;
+	if (timerfd_settime(ptPSXPads->iTimerFD, TFD_TIMER_ABSTIME, &tTimer, NULL) < 0) {
+		close(ptPSXPads->iTimerFD);
+		return -1;
+	}
+
+	ptPSXPads->u8PadsNum = i_u8PadNum;
+	ptPSXPads->u32PoolIntervalUs = PSXPAD_POOL_INTERVAL_US;
+	ptPSXPads->u32IdleTimeoutMs = PSXPAD_IDLE_TIMEOUT_MS;
+	ptPSXPads->tLastChange = ptPSXPads->tDeadline;
+
+	for (u8PadNo = 0; u8PadNo < ptPSXPads->u8PadsNum; u8PadNo++) {
+		ptPSXPads->ltPad[u8PadNo].u8PoolLen = sizeof(PSX_CMD_POLL);
+		memcpy(ptPSXPads->ltPad[u8PadNo].lu8PoolCmd, PSX_CMD_POLL, sizeof(PSX_CMD_POLL));
+		/* the wire order is asked once, the poll frame is kept in it */
+		if (ptPSXPads->ptTransport && ptPSXPads->ptTransport->fnMSBFirst && ptPSXPads->ptTransport->fnMSBFirst(ptPSXPads->pvTransport, u8PadNo)) {
+			ptPSXPads->ltPad[u8PadNo].bMSBFirst = 1;
+			PSXPads_ReverseBits(ptPSXPads->ltPad[u8PadNo].lu8PoolCmd, ptPSXPads->ltPad[u8PadNo].lu8PoolCmd, sizeof(ptPSXPads->ltPad[u8PadNo].lu8PoolCmd));
+		}
+		for (u8Loc = 0; u8Loc < sizeof(PSX_CMD_ENABLE_MOTOR); u8Loc++)
+			ptPSXPads->ltPad[u8PadNo].lu8EnableMotor[u8Loc] = PSX_CMD_ENABLE_MOTOR[u8Loc];
+		for (u8Loc = 0; u8Loc < sizeof(PSX_CMD_AD_MODE); u8Loc++)
+			ptPSXPads->ltPad[u8PadNo].lu8ADMode[u8Loc] = PSX_CMD_AD_MODE[u8Loc];
+	}
+
+	return 0;
+}
+
+/* the handle owns pvCtx once this succeeds, PSXPads_Uninit() closes it */
+struct PSXPads *PSXPads_InitTransport(const struct PSXPads_Transport *i_ptTransport, void *pvCtx, const uint8_t i_u8PadNum)
+{
+	struct PSXPads *ptPSXPads;
+
+	if (!i_ptTransport || !i_ptTransport->fnTransfer || i_u8PadNum == 0 || i_u8PadNum > PSXPAD_MAXPADNUM) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	ptPSXPads = calloc(1, sizeof(*ptPSXPads));
+	if (!ptPSXPads)
+		return NULL;
+	ptPSXPads->ptTransport = i_ptTransport;
+	ptPSXPads->pvTransport = pvCtx;
+
+	if (PSXPads_Setup(ptPSXPads, i_u8PadNum) < 0) {
+		free(ptPSXPads);
+		return NULL;
+	}
+
+	return ptPSXPads;
+}
+
+struct PSXPads *PSXPads_Init(const char i_strDevice[], const uint8_t i_u8PadNum)
+{
+	struct PSXPads *ptPSXPads;
+	struct PSXPads_SPI *ptSPI;
+	char strDevice[PATH_MAX];
+	uint8_t u8PadNo, u8LSBFirst;
+	int iErrno;
+
+	if (!i_strDevice || i_u8PadNum == 0 || i_u8PadNum > PSXPAD_MAXPADNUM) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	ptSPI = calloc(1, sizeof(*ptSPI));
+	if (!ptSPI)
+		return NULL;
+	for (u8PadNo = 0; u8PadNo < PSXPAD_MAXPADNUM; u8PadNo++)
+		ptSPI->liFD[u8PadNo] = -1;
+	ptSPI->u8PadsNum = i_u8PadNum;
+
+	for (u8PadNo = 0; u8PadNo < i_u8PadNum; u8PadNo++) {
+		if (PSXPads_SPIDevice(strDevice, sizeof(strDevice), i_strDevice, u8PadNo) < 0)
+			goto err;
+		ptSPI->liFD[u8PadNo] = open(strDevice, O_RDWR | O_CLOEXEC);
+		if (ptSPI->liFD[u8PadNo] < 0)
+			goto err;
+
+		/* mode 3, 125kbps */
+		if (PSXPads_SPIInit(ptSPI->liFD[u8PadNo], &(ptSPI->tTransfer), SPI_MODE_3, 8, 125000, 100) < 0)
+			goto err;
+
+		/* let the controller shift LSB first, else bits are swapped in SW */
+		u8LSBFirst = 1;
+		ptSPI->lbLSBFirst[u8PadNo] = (ioctl(ptSPI->liFD[u8PadNo], SPI_IOC_WR_LSB_FIRST, &u8LSBFirst) == -1) ? 0 : 1;
+	}
+
+	ptPSXPads = PSXPads_InitTransport(&tPSXPads_SPI, ptSPI, i_u8PadNum);
+	if (!ptPSXPads)
+		goto err;
+
+	return ptPSXPads;
+
+err:
+	iErrno = errno;
+	PSXPads_SPIClose(ptSPI);
+	errno = iErrno;
+	return NULL;
+}
+
+/*
+ * polls come from a trace instead of a transport, through the same decode and
+ * callbacks; at the recorded pace, or as fast as the callbacks allow.
+ * commands fail with ENOTSUP, the loop stops at the end of the trace.
+ */
+struct PSXPads *PSXPads_InitReplay(const char i_strTrace[], const uint8_t i_bRealTime)
+{
+	struct PSXPads *ptPSXPads;
+	int iErrno;
+
+	ptPSXPads = calloc(1, sizeof(*ptPSXPads));
+	if (!ptPSXPads)
+		return NULL;
+	ptPSXPads->bReplayRealTime = i_bRealTime ? 1 : 0;
+
+	ptPSXPads->ptReplay = PSXPadTrace_Open(i_strTrace);
+	if (!ptPSXPads->ptReplay)
+		goto err_free;
+	if (PSXPadTrace_Peek(ptPSXPads->ptReplay, &(ptPSXPads->u64ReplayFirstNs)) < 0)
+		goto err_close;
+
+	if (PSXPads_Setup(ptPSXPads, PSXPadTrace_PadsNum(ptPSXPads->ptReplay)) < 0)
+		goto err_close;
+	ptPSXPads->tReplayBase = ptPSXPads->tDeadline;
+
+	return ptPSXPads;
+
+err_close:
+	iErrno = errno;
+	PSXPadTrace_Close(ptPSXPads->ptReplay);
+	errno = iErrno;
+err_free:
+	free(ptPSXPads);
+	return NULL;
+}
+
+void PSXPads_Uninit(struct PSXPads *ptPSXPads)
+{
+	if (!ptPSXPads)
+		return;
+
+	PSXPadTrace_Close(ptPSXPads->ptRecord);
+	PSXPadTrace_Close(ptPSXPads->ptReplay);
+	close(ptPSXPads->iTimerFD);
+	if (ptPSXPads->ptTransport && ptPSXPads->ptTransport->fnClose)
+		ptPSXPads->ptTransport->fnClose(ptPSXPads->pvTransport);
+	free(ptPSXPads);
+}
+
+/* NULL ends the recording */
+int PSXPads_SetRecord(struct PSXPads *ptPSXPads, const char i_strTrace[])
+{
+	struct timespec tNow;
+	int ret;
+
+	if (!ptPSXPads) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	ret = PSXPadTrace_Close(ptPSXPads->ptRecord);
+	ptPSXPads->ptRecord = NULL;
+	if (!i_strTrace)
+		return ret;
+
+	clock_gettime(CLOCK_MONOTONIC, &tNow);
+	ptPSXPads->ptRecord = PSXPadTrace_Create(i_strTrace, ptPSXPads->u8PadsNum, (uint64_t)tNow.tv_sec * 1000000000 + tNow.tv_nsec);
+
+	return ptPSXPads->ptRecord ? 0 : -1;
+}
+
+/* i_lu8Send in the pad's wire order; a replay has no pads to send commands to */
+static int PSXPads_Transfer(struct PSXPads *ptPSXPads, const uint8_t u8PadNo, const uint8_t i_lu8Send[], uint8_t o_lu8Response[], const uint8_t i_u8Len)
+{
+	if (!ptPSXPads->ptTransport) {
+		errno = ENOTSUP;
+		return -1;
+	}
+
+	return ptPSXPads->ptTransport->fnTransfer(ptPSXPads->pvTransport, u8PadNo, i_lu8Send, o_lu8Response, i_u8Len);
+}
+
+int PSXPads_Command(struct PSXPads *ptPSXPads, const uint8_t u8PadNo, const uint8_t i_lu8SendCmd[], uint8_t o_lu8Response[], const uint8_t i_u8SendCmdLen)
+{
+	uint8_t lu8Send[0x100];
+
+	if (PSXPads_CheckPad(ptPSXPads, u8PadNo) < 0)
+		return -1;
+	if (!i_lu8SendCmd || !o_lu8Response || i_u8SendCmdLen == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* commands are rare, those for an MSB first pad are swapped into a copy */
+	if (!ptPSXPads->ltPad[u8PadNo].bMSBFirst)
+		return PSXPads_Transfer(ptPSXPads, u8PadNo, i_lu8SendCmd, o_lu8Response, i_u8SendCmdLen);
+
+	PSXPads_ReverseBits(lu8Send, i_lu8SendCmd, i_u8SendCmdLen);
+
+	return PSXPads_Transfer(ptPSXPads, u8PadNo, lu8Send, o_lu8Response, i_u8SendCmdLen);
+}
+
+/* a byte of the poll frame, in the pad's wire order */
+static void PSXPads_SetPoolCmd(struct PSXPad *ptPad, const uint8_t u8Loc, const uint8_t i_u8Value)
+{
+	ptPad->lu8PoolCmd[u8Loc] = ptPad->bMSBFirst ? lu8ReverseBit[i_u8Value] : i_u8Value;
+}
+
+/* low nibble of the mode ID is the number of 16-bit data words, 0 is 16 */
+static uint8_t PSXPads_FrameLen(const uint8_t i_u8Mode)
+{
+	uint8_t u8Words = i_u8Mode & 0x0F;
+
+	if (u8Words == 0)
+		u8Words = 16;
+	if (3 + u8Words * 2 > PSXPAD_FRAME_MAX)
+		return PSXPAD_FRAME_MAX;
+
+	return 3 + u8Words * 2;
+}
+
+/* which ports of a pad changed since its last frame */
+static uint8_t PSXPads_Changed(const struct PSXPad *ptPad, const uint8_t i_u8Len)
+{
+	uint8_t u8Port, u8Changed = 0;
+
+	if (!ptPad->bMultitap || ptPad->lu8Response[1] != 0x80)
+		return memcmp(ptPad->lu8Response, ptPad->lu8LastResponse, i_u8Len) ? 0x01 : 0x00;
+
+	for (u8Port = 0; u8Port < PSXPAD_TAP_PORTS; u8Port++)
+		if (memcmp(&ptPad->lu8Response[2 + u8Port * PSXPAD_TAP_SLOT_LEN], &ptPad->lu8LastResponse[2 + u8Port * PSXPAD_TAP_SLOT_LEN], PSXPAD_TAP_SLOT_LEN))
+			u8Changed |= 1 << u8Port;
+
+	return u8Changed;
+}
+
+/*
+ * the poll frame of every pad, in one go when the transport can; the first
+ * pad is rotated every cycle so no pad is always sampled last
+ * not staggered like the kernel driver: fnPoll clocks the pads side by side
+ * and one cycle is one wakeup and one trace record
+ */
+static int PSXPads_PoolTransport(struct PSXPads *ptPSXPads)
+{
+	const uint8_t *lpu8Send[PSXPAD_MAXPADNUM];
+	uint8_t *lpu8Response[PSXPAD_MAXPADNUM];
+	uint8_t lu8PadNo[PSXPAD_MAXPADNUM];
+	uint8_t lu8Len[PSXPAD_MAXPADNUM];
+	uint8_t u8PadNo, u8Num;
+	struct PSXPad *ptPad;
+
+	for (u8Num = 0; u8Num < ptPSXPads->u8PadsNum; u8Num++) {
+		u8PadNo = (ptPSXPads->u8PoolFirst + u8Num) % ptPSXPads->u8PadsNum;
+		ptPad = &(ptPSXPads->ltPad[u8PadNo]);
+
+		lu8PadNo[u8Num] = u8PadNo;
+		lpu8Send[u8Num] = ptPad->lu8PoolCmd;
+		lpu8Response[u8Num] = ptPad->lu8Response;
+		lu8Len[u8Num] = ptPad->u8PoolLen;
+	}
+	ptPSXPads->u8PoolFirst = (ptPSXPads->u8PoolFirst + 1) % ptPSXPads->u8PadsNum;
+
+	if (ptPSXPads->ptTransport->fnPoll)
+		return (ptPSXPads->ptTransport->fnPoll(ptPSXPads->pvTransport, ptPSXPads->u8PadsNum, lu8PadNo, lpu8Send, lpu8Response, lu8Len) < 0) ? -1 : 1;
+
+	for (u8Num = 0; u8Num < ptPSXPads->u8PadsNum; u8Num++)
+		if (ptPSXPads->ptTransport->fnTransfer(ptPSXPads->pvTransport, lu8PadNo[u8Num], lpu8Send[u8Num], lpu8Response[u8Num], lu8Len[u8Num]) < 0)
+			return -1;
+
+	return 1;
+}
+
+/* the next recorded cycle, 0 and the loop stopped at the end of the trace */
+static int PSXPads_PoolReplay(struct PSXPads *ptPSXPads)
+{
+	uint8_t llu8Frame[PSXPAD_MAXPADNUM][PSXPADTRACE_FRAME_MAX];
+	uint8_t lu8Len[PSXPAD_MAXPADNUM];
+	uint8_t u8PadNo;
+	struct PSXPad *ptPad;
+	int ret;
+
+	ret = PSXPadTrace_Read(ptPSXPads->ptReplay, NULL, llu8Frame, lu8Len);
+	if (ret == 0)
+		ptPSXPads->bStop = 1;
+	if (ret <= 0)
+		return ret;
+
+	for (u8PadNo = 0; u8PadNo < ptPSXPads->u8PadsNum; u8PadNo++) {
+		ptPad = &(ptPSXPads->ltPad[u8PadNo]);
+		ptPad->u8PoolLen = (lu8Len[u8PadNo] < PSXPAD_FRAME_MAX) ? lu8Len[u8PadNo] : PSXPAD_FRAME_MAX;
+		memset(ptPad->lu8Response, 0, sizeof(ptPad->lu8Response));
+		memcpy(ptPad->lu8Response, llu8Frame[u8PadNo], ptPad->u8PoolLen);
+
+		/* there was no detection, a multitap is known by its frames */
+		if (ptPad->lu8Response[2] == 0x5A)
+			ptPad->bMultitap = (ptPad->lu8Response[1] == 0x80) ? 1 : 0;
+	}
+
+	return 1;
+}
+
+/* the frames of this cycle as the decoder saw them */
+static int PSXPads_Record(struct PSXPads *ptPSXPads)
+{
+	const uint8_t *lpu8Frame[PSXPAD_MAXPADNUM];
+	uint8_t lu8Len[PSXPAD_MAXPADNUM];
+	uint8_t u8PadNo;
+	struct timespec tNow;
+
+	for (u8PadNo = 0; u8PadNo < ptPSXPads->u8PadsNum; u8PadNo++) {
+		lpu8Frame[u8PadNo] = ptPSXPads->ltPad[u8PadNo].lu8Response;
+		lu8Len[u8PadNo] = ptPSXPads->ltPad[u8PadNo].u8PoolLen;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &tNow);
+
+	return PSXPadTrace_Write(ptPSXPads->ptRecord, (uint64_t)tNow.tv_sec * 1000000000 + tNow.tv_nsec, lpu8Frame, lu8Len);
+}
+
+int PSXPads_Pool(struct PSXPads *ptPSXPads)
+{
+	uint8_t u8PadNo, u8Len;
+	struct PSXPad *ptPad;
+	int ret;
+
+	if (PSXPads_CheckPad(ptPSXPads, 0) < 0)
+		return -1;
+
+	for (u8PadNo = 0; u8PadNo < ptPSXPads->u8PadsNum; u8PadNo++)
+		ptPSXPads->ltPad[u8PadNo].u8Changed = 0;
+
+	ret = ptPSXPads->ptReplay ? PSXPads_PoolReplay(ptPSXPads) : PSXPads_PoolTransport(ptPSXPads);
+	if (ret <= 0)
+		return ret;
+
+	for (u8PadNo = 0; u8PadNo < ptPSXPads->u8PadsNum; u8PadNo++) {
+		ptPad = &(ptPSXPads->ltPad[u8PadNo]);
+
+		if (ptPad->lu8Response[2] != 0x5A) {
+			/* unplugged, reported once */
+			if (ptPad->bPresent)
+				ptPad->u8Changed = ptPad->bMultitap ? 0x0F : 0x01;
+			ptPad->bPresent = 0;
+			continue;
+		}
+
+		/* poll length follows the last frame, extended when the mode grows */
+		u8Len = PSXPads_FrameLen(ptPad->lu8Response[1]);
+		if (u8Len > ptPad->u8PoolLen && !ptPSXPads->ptReplay) {
+			ptPad->u8PoolLen = u8Len;
+			if (PSXPads_Transfer(ptPSXPads, u8PadNo, ptPad->lu8PoolCmd, ptPad->lu8Response, ptPad->u8PoolLen) < 0)
+				return -1;
+		}
+		ptPad->u8PoolLen = u8Len;
+
+		/* a pad plugged in or a changed frame resets the idle back-off */
+		ptPad->u8Changed = PSXPads_Changed(ptPad, u8Len);
+		if (!ptPad->bPresent)
+			ptPad->u8Changed = ptPad->bMultitap ? 0x0F : 0x01;
+		if (ptPad->u8Changed) {
+			memcpy(ptPad->lu8LastResponse, ptPad->lu8Response, u8Len);
+			clock_gettime(CLOCK_MONOTONIC, &(ptPSXPads->tLastChange));
+		}
+		ptPad->bPresent = 1;
+	}
+
+	if (ptPSXPads->ptRecord && PSXPads_Record(ptPSXPads) < 0)
+		return -1;
+
+	return 0;
+}
+
+/* microseconds to wait until the next PSXPads_Pool(), longer while the pads sit idle */
+uint32_t PSXPads_PoolInterval(struct PSXPads *ptPSXPads)
+{
+	struct timespec tNow;
+	int64_t i64IdleMs;
+	uint8_t u8PadNo, bPresent = 0;
+
+	if (!ptPSXPads)
+		return PSXPAD_POOL_INTERVAL_US;
+	if (ptPSXPads->u32IdleTimeoutMs == 0)
+		return ptPSXPads->u32PoolIntervalUs;
+
+	clock_gettime(CLOCK_MONOTONIC, &tNow);
+	i64IdleMs = (int64_t)(tNow.tv_sec - ptPSXPads->tLastChange.tv_sec) * 1000 + (tNow.tv_nsec - ptPSXPads->tLastChange.tv_nsec) / 1000000;
+	if (i64IdleMs < ptPSXPads->u32IdleTimeoutMs)
+		return ptPSXPads->u32PoolIntervalUs;
+
+	for (u8PadNo = 0; u8PadNo < ptPSXPads->u8PadsNum; u8PadNo++)
+		bPresent |= ptPSXPads->ltPad[u8PadNo].bPresent;
+	if (!bPresent)
+		return PSXPAD_HOTPLUG_INTERVAL_US;
+	if (i64IdleMs < 2 * (int64_t)ptPSXPads->u32IdleTimeoutMs)
+		return PSXPAD_IDLE_INTERVAL_US;
+
+	return PSXPAD_IDLE_INTERVAL2_US;
+}
+
+/* full rate interval, clamped to 1-32ms; the idle steps are never shorter */
+void PSXPads_SetPoolInterval(struct PSXPads *ptPSXPads, const uint32_t i_u32IntervalUs)
+{
+	if (!ptPSXPads)
+		return;
+
+	if (i_u32IntervalUs < PSXPAD_POOL_INTERVAL_US_MIN)
+		ptPSXPads->u32PoolIntervalUs = PSXPAD_POOL_INTERVAL_US_MIN;
+	else if (i_u32IntervalUs > PSXPAD_POOL_INTERVAL_US_MAX)
+		ptPSXPads->u32PoolIntervalUs = PSXPAD_POOL_INTERVAL_US_MAX;
+	else
+		ptPSXPads->u32PoolIntervalUs = i_u32IntervalUs;
+}
+
+/* 0 keeps polling at the full rate */
+void PSXPads_SetIdleTimeout(struct PSXPads *ptPSXPads, const uint32_t i_u32IdleTimeoutMs)
+{
+	if (!ptPSXPads)
+		return;
+
+	ptPSXPads->u32IdleTimeoutMs = i_u32IdleTimeoutMs;
+}
+
+int PSXPads_DetectMultitap(struct PSXPads *ptPSXPads, const uint8_t u8PadNo)
+{
+	struct PSXPad *ptPad;
+
+	if (PSXPads_CheckPad(ptPSXPads, u8PadNo) < 0)
+		return -1;
+
+	ptPad = &(ptPSXPads->ltPad[u8PadNo]);
+
+	if (PSXPads_Command(ptPSXPads, u8PadNo, PSX_CMD_TAP_POLL, ptPad->lu8Response, sizeof(PSX_CMD_TAP_POLL)) < 0)
+		return -1;
+	ptPad->bMultitap = (ptPad->lu8Response[2] == 0x5A && ptPad->lu8Response[1] == 0x80) ? 1 : 0;
+
+	/* motor bytes would fall on port A's slot */
+	if (ptPad->bMultitap) {
+		ptPad->u8PoolLen = sizeof(PSX_CMD_TAP_POLL);
+		PSXPads_SetPoolCmd(ptPad, 2, PSX_CMD_TAP_POLL[2]);
+		PSXPads_SetPoolCmd(ptPad, 3, 0x00);
+		PSXPads_SetPoolCmd(ptPad, 4, 0x00);
+	} else {
+		PSXPads_SetPoolCmd(ptPad, 2, PSX_CMD_POLL[2]);
+		PSXPads_SetPoolCmd(ptPad, 3, ptPad->u8Motor1Level);
+		PSXPads_SetPoolCmd(ptPad, 4, ptPad->u8Motor2Level);
+	}
+
+	return 0;
+}
+
+/*
+ * enter config, the commands in turn, exit config; stops at the first failure.
+ * the replies go to a buffer of its own, the last poll frames stay decodable
+ */
+static int PSXPads_Config(struct PSXPads *ptPSXPads, const uint8_t u8PadNo, const uint8_t *i_lpu8Cmd[], const uint8_t i_lu8Len[], const uint8_t i_u8Num)
+{
+	uint8_t lu8Response[PSXPAD_FRAME_MAX];
+	uint8_t u8Num;
+
+	if (PSXPads_Command(ptPSXPads, u8PadNo, PSX_CMD_ENTER_CFG, lu8Response, sizeof(PSX_CMD_ENTER_CFG)) < 0)
+		return -1;
+	for (u8Num = 0; u8Num < i_u8Num; u8Num++)
+		if (PSXPads_Command(ptPSXPads, u8PadNo, i_lpu8Cmd[u8Num], lu8Response, i_lu8Len[u8Num]) < 0)
+			return -1;
+
+	return PSXPads_Command(ptPSXPads, u8PadNo, PSX_CMD_EXIT_CFG, lu8Response, sizeof(PSX_CMD_EXIT_CFG));
+}
+
+int PSXPads_SetADMode(struct PSXPads *ptPSXPads, const uint8_t u8PadNo, const uint8_t i_bAnalog, const uint8_t i_bLock)
+{
+	const uint8_t *lpu8Cmd[1];
+	const uint8_t lu8Len[1] = {sizeof(PSX_CMD_AD_MODE)};
+
+	if (PSXPads_CheckPad(ptPSXPads, u8PadNo) < 0)
+		return -1;
+
+	ptPSXPads->ltPad[u8PadNo].bAnalog = i_bAnalog ? 1 : 0;
+	ptPSXPads->ltPad[u8PadNo].bLock   = i_bLock   ? 1 : 0;
+
+	ptPSXPads->ltPad[u8PadNo].lu8ADMode[3] = ptPSXPads->ltPad[u8PadNo].bAnalog ? 0x01 : 0x00;
+	ptPSXPads->ltPad[u8PadNo].lu8ADMode[4] = ptPSXPads->ltPad[u8PadNo].bLock   ? 0x03 : 0x00;
+
+	lpu8Cmd[0] = ptPSXPads->ltPad[u8PadNo].lu8ADMode;
+
+	return PSXPads_Config(ptPSXPads, u8PadNo, lpu8Cmd, lu8Len, 1);
+}
+
+/*
+ * pressure mode (ID 0x79) needs analog mode first. as in psxpad-spi, it is
+ * only switched back off when the pad is in it, pads without it may not
+ * take 0x4F; off still reports buttons and sticks.
+ */
+int PSXPads_SetPressure(struct PSXPads *ptPSXPads, const uint8_t u8PadNo, const uint8_t i_bPressure)
+{
+	const uint8_t *lpu8Cmd[2];
+	uint8_t lu8Len[2];
+	uint8_t lu8Mask[sizeof(PSX_CMD_ALL_PRESSURE)];
+
+	if (PSXPads_CheckPad(ptPSXPads, u8PadNo) < 0)
+		return -1;
+
+	if (i_bPressure) {
+		lpu8Cmd[0] = PSX_CMD_INIT_PRESSURE;
+		lu8Len[0] = sizeof(PSX_CMD_INIT_PRESSURE);
+		lpu8Cmd[1] = PSX_CMD_ALL_PRESSURE;
+		lu8Len[1] = sizeof(PSX_CMD_ALL_PRESSURE);
+
+		return PSXPads_Config(ptPSXPads, u8PadNo, lpu8Cmd, lu8Len, 2);
+	}
+
+	if (!ptPSXPads->ltPad[u8PadNo].bPresent || ptPSXPads->ltPad[u8PadNo].lu8Response[1] != 0x79)
+		return 0;
+
+	memcpy(lu8Mask, PSX_CMD_ALL_PRESSURE, sizeof(lu8Mask));
+	lu8Mask[3] = 0x3F;
+	lu8Mask[4] = 0x00;
+	lu8Mask[5] = 0x00;
+	lpu8Cmd[0] = lu8Mask;
+	lu8Len[0] = sizeof(lu8Mask);
+
+	return PSXPads_Config(ptPSXPads, u8PadNo, lpu8Cmd, lu8Len, 1);
+}
+
+int PSXPads_SetEnableMotor(struct PSXPads *ptPSXPads, const uint8_t u8PadNo, const uint8_t i_bMotor1Enable, const uint8_t i_bMotor2Enable)
+{
+	const uint8_t *lpu8Cmd[1];
+	const uint8_t lu8Len[1] = {sizeof(PSX_CMD_ENABLE_MOTOR)};
+
+	if (PSXPads_CheckPad(ptPSXPads, u8PadNo) < 0)
+		return -1;
+
+	ptPSXPads->ltPad[u8PadNo].bMotor1Enable = i_bMotor1Enable ? 1 : 0;
+	ptPSXPads->ltPad[u8PadNo].bMotor2Enable = i_bMotor2Enable ? 1 : 0;
+
+	ptPSXPads->ltPad[u8PadNo].lu8EnableMotor[3] = ptPSXPads->ltPad[u8PadNo].bMotor1Enable ? 0x00 : 0xFF;
+	ptPSXPads->ltPad[u8PadNo].lu8EnableMotor[4] = ptPSXPads->ltPad[u8PadNo].bMotor2Enable ? 0x01 : 0xFF;
+
+	lpu8Cmd[0] = ptPSXPads->ltPad[u8PadNo].lu8EnableMotor;
+
+	return PSXPads_Config(ptPSXPads, u8PadNo, lpu8Cmd, lu8Len, 1);
+}
+
+int PSXPads_SetMotorLevel(struct PSXPads *ptPSXPads, const uint8_t u8PadNo, const uint8_t i_u8Motor1Level, const uint8_t i_u8Motor2Level)
+{
+	if (PSXPads_CheckPad(ptPSXPads, u8PadNo) < 0)
+		return -1;
+
+	ptPSXPads->ltPad[u8PadNo].u8Motor1Level = i_u8Motor1Level ? 0xFF : 0x00;
+	ptPSXPads->ltPad[u8PadNo].u8Motor2Level = i_u8Motor2Level;
+
+	if (ptPSXPads->ltPad[u8PadNo].bMultitap)
+		return 0;
+
+	PSXPads_SetPoolCmd(&(ptPSXPads->ltPad[u8PadNo]), 3, ptPSXPads->ltPad[u8PadNo].u8Motor1Level);
+	PSXPads_SetPoolCmd(&(ptPSXPads->ltPad[u8PadNo]), 4, ptPSXPads->ltPad[u8PadNo].u8Motor2Level);
+
+	return 0;
+}
+
+/*
+ * decode table per controller type: buttons it has (bits of data bytes 3-4),
+ * frame offset of RX, RY, LX, LY (0 = centered) and of 12 pressure bytes.
+ * guitars identify as digital or analog and decode through those entries.
+ */
+struct PSXPad_Desc {
+	uint8_t u8Mode;
+	uint8_t u8Len;
+	int vType;
+	uint16_t u16Buttons;
+	uint8_t lu8Axis[4];
+	uint8_t u8Pressure;
+};
+
+static const struct PSXPad_Desc ltPSXPadDesc[] = {
+	{0x41,  5, PSXPAD_KEYSTATE_TYPE_DIGITAL, 0xFFF9, {0, 0, 0, 0}, 0},
+	{0x73,  9, PSXPAD_KEYSTATE_TYPE_ANALOG1, 0xFFFF, {5, 6, 7, 8}, 0},
+	{0x79, 21, PSXPAD_KEYSTATE_TYPE_ANALOG2, 0xFFFF, {5, 6, 7, 8}, 9},
+	{0x53,  9, PSXPAD_KEYSTATE_TYPE_ANALOG1, 0xFFFF, {5, 6, 7, 8}, 0},
+	/* NeGcon: RX = I, RY = II, LX = twist, LY = L */
+	{0x23,  9, PSXPAD_KEYSTATE_TYPE_NEGCON,  0x38F8, {6, 7, 5, 8}, 0},
+	/* mouse: buttons only, motion is relative */
+	{0x12,  7, PSXPAD_KEYSTATE_TYPE_MOUSE,   0x0C00, {0, 0, 0, 0}, 0}
+};
+
+/* key state field of each button bit */
+static const uint8_t lu8PSXPadButton[16] = {
+	offsetof(struct PSXPad_KeyState, bSel), offsetof(struct PSXPad_KeyState, bL3),  offsetof(struct PSXPad_KeyState, bR3),  offsetof(struct PSXPad_KeyState, bStt),
+	offsetof(struct PSXPad_KeyState, bU),   offsetof(struct PSXPad_KeyState, bR),   offsetof(struct PSXPad_KeyState, bD),   offsetof(struct PSXPad_KeyState, bL),
+	offsetof(struct PSXPad_KeyState, bL2),  offsetof(struct PSXPad_KeyState, bR2),  offsetof(struct PSXPad_KeyState, bL1),  offsetof(struct PSXPad_KeyState, bR1),
+	offsetof(struct PSXPad_KeyState, bTri), offsetof(struct PSXPad_KeyState, bCir), offsetof(struct PSXPad_KeyState, bCrs), offsetof(struct PSXPad_KeyState, bSqr)
+};
+
+/* i_lu8Frame[1] is the mode ID, i_lu8Frame[2] the 0x5A marker, data follows; NULL is no pad */
+static void PSXPads_DecodePacked(const uint8_t i_lu8Frame[], const uint8_t i_u8Len, struct PSXPad_PackedState *o_ptState)
+{
+	const struct PSXPad_Desc *ptDesc = NULL;
+	int i;
+
+	memset(o_ptState, 0, sizeof(*o_ptState));
+	o_ptState->u8Type = PSXPAD_KEYSTATE_TYPE_UNKNOWN;
+	if (!i_lu8Frame)
+		return;
+
+	for (i = 0; i < sizeof(ltPSXPadDesc) / sizeof(ltPSXPadDesc[0]); i++) {
+		if (ltPSXPadDesc[i].u8Mode == i_lu8Frame[1]) {
+			ptDesc = &ltPSXPadDesc[i];
+			break;
+		}
+	}
+	if (!ptDesc || ptDesc->u8Len > i_u8Len)
+		return;
+
+	o_ptState->u8Type = ptDesc->vType;
+
+	/* button data is inverted */
+	o_ptState->u16Buttons = ~(i_lu8Frame[3] | i_lu8Frame[4] << 8) & ptDesc->u16Buttons;
+
+	for (i = 0; i < 4; i++)
+		o_ptState->lu8Axis[i] = ptDesc->lu8Axis[i] ? i_lu8Frame[ptDesc->lu8Axis[i]] : 0x80;
+
+	if (ptDesc->u8Pressure)
+		memcpy(o_ptState->lu8Pressure, &i_lu8Frame[ptDesc->u8Pressure], sizeof(o_ptState->lu8Pressure));
+}
+
+static void PSXPads_Unpack(const struct PSXPad_PackedState *i_ptState, struct PSXPad_KeyState *o_ptKeyState)
+{
+	uint8_t *pu8KeyState = (uint8_t *)o_ptKeyState;
+	int i;
+
+	o_ptKeyState->vType = i_ptState->u8Type;
+	for (i = 0; i < 16; i++)
+		pu8KeyState[lu8PSXPadButton[i]] = (i_ptState->u16Buttons >> i) & 1;
+
+	/* u8RX, u8RY, u8LX, u8LY and u8AR to u8AR2 follow the packed order */
+	memcpy(&o_ptKeyState->u8RX, i_ptState->lu8Axis, sizeof(i_ptState->lu8Axis));
+	memcpy(&o_ptKeyState->u8AR, i_ptState->lu8Pressure, sizeof(i_ptState->lu8Pressure));
+}
+
+/* frame a pad, or a port behind a multitap, decodes from; NULL while there is none */
+static const uint8_t *PSXPads_PortFrame(const struct PSXPad *ptPad, const uint8_t u8Port, uint8_t *o_pu8Len)
+{
+	const uint8_t *pu8Slot;
+
+	if (!ptPad->bPresent)
+		return NULL;
+	if (!ptPad->bMultitap || ptPad->lu8Response[1] != 0x80) {
+		*o_pu8Len = ptPad->u8PoolLen;
+		return (u8Port == 0) ? ptPad->lu8Response : NULL;
+	}
+
+	/* each slot has the layout of a frame without the HiZ byte */
+	pu8Slot = &ptPad->lu8Response[2 + u8Port * PSXPAD_TAP_SLOT_LEN];
+	if (pu8Slot[2] != 0x5A)
+		return NULL;
+	*o_pu8Len = PSXPAD_TAP_SLOT_LEN + 1;
+
+	return pu8Slot;
+}
+
+int PSXPads_GetKeyState(struct PSXPads *ptPSXPads, const uint8_t u8PadNo, struct PSXPad_KeyState *o_ptKeyState)
+{
+	struct PSXPad_PackedState tState;
+	const struct PSXPad *ptPad;
+
+	if (PSXPads_CheckPad(ptPSXPads, u8PadNo) < 0)
+		return -1;
+	if (!o_ptKeyState) {
+		errno = EINVAL;
+		return -1;
+	}
+	ptPad = &(ptPSXPads->ltPad[u8PadNo]);
+
+	PSXPads_DecodePacked(ptPad->bPresent ? ptPad->lu8Response : NULL, ptPad->u8PoolLen, &tState);
+	PSXPads_Unpack(&tState, o_ptKeyState);
+
+	return 0;
+}
+
+int PSXPads_GetTapKeyState(struct PSXPads *ptPSXPads, const uint8_t u8PadNo, const uint8_t u8Port, struct PSXPad_KeyState *o_ptKeyState)
+{
+	struct PSXPad_PackedState tState;
+	const struct PSXPad *ptPad;
+	const uint8_t *pu8Frame = NULL;
+	uint8_t u8Len = 0;
+
+	if (PSXPads_CheckPad(ptPSXPads, u8PadNo) < 0)
+		return -1;
+	if (u8Port >= PSXPAD_TAP_PORTS || !o_ptKeyState) {
+		errno = EINVAL;
+		return -1;
+	}
+	ptPad = &(ptPSXPads->ltPad[u8PadNo]);
+
+	if (ptPad->bMultitap && ptPad->lu8Response[1] == 0x80)
+		pu8Frame = PSXPads_PortFrame(ptPad, u8Port, &u8Len);
+	PSXPads_DecodePacked(pu8Frame, u8Len, &tState);
+	PSXPads_Unpack(&tState, o_ptKeyState);
+
+	return 0;
+}
+
+int PSXPads_GetPackedState(struct PSXPads *ptPSXPads, const uint8_t u8PadNo, const uint8_t u8Port, struct PSXPad_PackedState *o_ptState)
+{
+	const uint8_t *pu8Frame;
+	uint8_t u8Len = 0;
+
+	if (PSXPads_CheckPad(ptPSXPads, u8PadNo) < 0)
+		return -1;
+	if (u8Port >= PSXPAD_TAP_PORTS || !o_ptState) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	pu8Frame = PSXPads_PortFrame(&(ptPSXPads->ltPad[u8PadNo]), u8Port, &u8Len);
+	PSXPads_DecodePacked(pu8Frame, u8Len, o_ptState);
+
+	return 0;
+}
+
+int PSXPads_GetPackedStates(struct PSXPads *ptPSXPads, struct PSXPad_PackedState o_ltState[][PSXPAD_TAP_PORTS])
+{
+	const uint8_t *pu8Frame;
+	uint8_t u8PadNo, u8Port, u8Len = 0;
+
+	if (PSXPads_CheckPad(ptPSXPads, 0) < 0)
+		return -1;
+	if (!o_ltState) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	for (u8PadNo = 0; u8PadNo < ptPSXPads->u8PadsNum; u8PadNo++) {
+		for (u8Port = 0; u8Port < PSXPAD_TAP_PORTS; u8Port++) {
+			pu8Frame = PSXPads_PortFrame(&(ptPSXPads->ltPad[u8PadNo]), u8Port, &u8Len);
+			PSXPads_DecodePacked(pu8Frame, u8Len, &o_ltState[u8PadNo][u8Port]);
+		}
+	}
+
+	return 0;
+}
+
+const uint8_t *PSXPads_GetFrame(struct PSXPads *ptPSXPads, const uint8_t u8PadNo, uint8_t *o_pu8Len)
+{
+	if (PSXPads_CheckPad(ptPSXPads, u8PadNo) < 0)
+		return NULL;
+
+	if (o_pu8Len)
+		*o_pu8Len = ptPSXPads->ltPad[u8PadNo].u8PoolLen;
+
+	return ptPSXPads->ltPad[u8PadNo].lu8Response;
+}
+
+int PSXPads_SetCallback(struct PSXPads *ptPSXPads, PSXPads_Callback i_fnCallback, void *i_pvUser)
+{
+	if (!ptPSXPads) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	ptPSXPads->fnCallback = i_fnCallback;
+	ptPSXPads->pvUser = i_pvUser;
+
+	return 0;
+}
+
+int PSXPads_GetPadsNum(const struct PSXPads *ptPSXPads)
+{
+	if (!ptPSXPads) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return ptPSXPads->u8PadsNum;
+}
+
+int PSXPads_GetFD(const struct PSXPads *ptPSXPads)
+{
+	if (!ptPSXPads) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return ptPSXPads->iTimerFD;
+}
+
+static void PSXPads_TimespecAdd(struct timespec *io_ptTime, const uint32_t i_u32Us)
+{
+	io_ptTime->tv_sec += i_u32Us / 1000000;
+	io_ptTime->tv_nsec += (long)(i_u32Us % 1000000) * 1000;
+	if (io_ptTime->tv_nsec >= 1000000000) {
+		io_ptTime->tv_sec++;
+		io_ptTime->tv_nsec -= 1000000000;
+	}
+}
+
+static int PSXPads_TimespecBefore(const struct timespec *i_ptA, const struct timespec *i_ptB)
+{
+	if (i_ptA->tv_sec != i_ptB->tv_sec)
+		return i_ptA->tv_sec < i_ptB->tv_sec;
+
+	return i_ptA->tv_nsec < i_ptB->tv_nsec;
+}
+
+static void PSXPads_Notify(struct PSXPads *ptPSXPads)
+{
+	struct PSXPad_PackedState tState;
+	uint8_t u8PadNo, u8Port;
+
+	if (!ptPSXPads->fnCallback)
+		return;
+
+	for (u8PadNo = 0; u8PadNo < ptPSXPads->u8PadsNum; u8PadNo++) {
+		for (u8Port = 0; u8Port < PSXPAD_TAP_PORTS; u8Port++) {
+			if (!(ptPSXPads->ltPad[u8PadNo].u8Changed & (1 << u8Port)))
+				continue;
+
+			PSXPads_GetPackedState(ptPSXPads, u8PadNo, u8Port, &tState);
+			ptPSXPads->fnCallback(ptPSXPads, u8PadNo, u8Port, &tState, ptPSXPads->pvUser);
+		}
+	}
+}
+
+/* a replayed cycle is due as long after the start as it was recorded, or right away */
+static int PSXPads_ReplayDeadline(struct PSXPads *ptPSXPads)
+{
+	uint64_t u64TimeNs;
+	int ret;
+
+	if (!ptPSXPads->bReplayRealTime) {
+		clock_gettime(CLOCK_MONOTONIC, &(ptPSXPads->tDeadline));
+		return 0;
+	}
+
+	/* at the end the next poll finds out, right away */
+	ret = PSXPadTrace_Peek(ptPSXPads->ptReplay, &u64TimeNs);
+	if (ret <= 0) {
+		clock_gettime(CLOCK_MONOTONIC, &(ptPSXPads->tDeadline));
+		return ret;
+	}
+
+	u64TimeNs -= ptPSXPads->u64ReplayFirstNs;
+	ptPSXPads->tDeadline.tv_sec = ptPSXPads->tReplayBase.tv_sec + u64TimeNs / 1000000000;
+	ptPSXPads->tDeadline.tv_nsec = ptPSXPads->tReplayBase.tv_nsec + u64TimeNs % 1000000000;
+	if (ptPSXPads->tDeadline.tv_nsec >= 1000000000) {
+		ptPSXPads->tDeadline.tv_sec++;
+		ptPSXPads->tDeadline.tv_nsec -= 1000000000;
+	}
+
+	return 0;
+}
+
+/*
+ * polls once the deadline has passed, hands changes to the callback and arms
+ * the next deadline; deadlines advance from the previous one, not from now,
+ * so transfer and callback time don't add up to drift, and missed ones are
+ * skipped rather than caught up
+ */
+int PSXPads_Dispatch(struct PSXPads *ptPSXPads)
+{
+	struct itimerspec tTimer;
+	struct timespec tNow;
+	uint64_t u64Expired;
+	uint32_t u32Interval;
+
+	if (!ptPSXPads) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &tNow);
+	if (!PSXPads_TimespecBefore(&tNow, &(ptPSXPads->tDeadline))) {
+		if (read(ptPSXPads->iTimerFD, &u64Expired, sizeof(u64Expired)) < 0 && errno != EAGAIN)
+			return -1;
+		if (PSXPads_Pool(ptPSXPads) < 0)
+			return -1;
+		PSXPads_Notify(ptPSXPads);
+
+		if (ptPSXPads->ptReplay) {
+			if (PSXPads_ReplayDeadline(ptPSXPads) < 0)
+				return -1;
+		} else {
+			u32Interval = PSXPads_PoolInterval(ptPSXPads);
+			do {
+				PSXPads_TimespecAdd(&(ptPSXPads->tDeadline), u32Interval);
+			} while (!PSXPads_TimespecBefore(&tNow, &(ptPSXPads->tDeadline)));
+		}
+	}
+
+	memset(&tTimer, 0, sizeof(tTimer));
+	tTimer.it_value = ptPSXPads->tDeadline;
+
+	return timerfd_settime(ptPSXPads->iTimerFD, TFD_TIMER_ABSTIME, &tTimer, NULL);
+}
+
+/* blocking loop for callers without an event loop of their own */
+int PSXPads_Run(struct PSXPads *ptPSXPads)
+{
+	struct epoll_event tEvent;
+	int iEpollFD, ret = 0;
+
+	if (!ptPSXPads) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* nothing to wait for when replaying at full speed */
+	if (ptPSXPads->ptReplay && !ptPSXPads->bReplayRealTime) {
+		ptPSXPads->bStop = 0;
+		while (!ptPSXPads->bStop) {
+			if (PSXPads_Pool(ptPSXPads) < 0)
+				return -1;
+			PSXPads_Notify(ptPSXPads);
+		}
+		return 0;
+	}
+
+	iEpollFD = epoll_create1(EPOLL_CLOEXEC);
+	if (iEpollFD < 0)
+		return -1;
+
+	tEvent.events = EPOLLIN;
+	tEvent.data.ptr = ptPSXPads;
+	if (epoll_ctl(iEpollFD, EPOLL_CTL_ADD, ptPSXPads->iTimerFD, &tEvent) < 0) {
+		close(iEpollFD);
+		return -1;
+	}
+
+	ptPSXPads->bStop = 0;
+
+	ret = PSXPads_Dispatch(ptPSXPads);
+	while (ret == 0 && !ptPSXPads->bStop) {
+		ret = epoll_wait(iEpollFD, &tEvent, 1, -1);
+		if (ret < 0 && errno == EINTR) {
+			ret = 0;
+			continue;
+		}
+		if (ret > 0)
+			ret = PSXPads_Dispatch(ptPSXPads);
+	}
+
+	close(iEpollFD);
+
+	return ret < 0 ? -1 : 0;
+}
+
+/* may be called from a callback or a signal handler */
+void PSXPads_Stop(struct PSXPads *ptPSXPads)
+{
+	if (ptPSXPads)
+		ptPSXPads->bStop = 1;
+}
@@ -0,0 +1,207 @@
+/*
+ * PSX(Play Station 1/2) pad library (using spidev driver)
+ *
+ * Copyright (c) 2017 AZO
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License.
+ */
+
+#ifndef LIBPSXPAD_H
+#define LIBPSXPAD_H
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PSXPAD_MAXPADNUM	8
+#define PSXPAD_TAP_PORTS	4
+
+enum {
+	PSXPAD_KEYSTATE_TYPE_DIGITAL = 0,
+	PSXPAD_KEYSTATE_TYPE_ANALOG1,
+	PSXPAD_KEYSTATE_TYPE_ANALOG2,
+	PSXPAD_KEYSTATE_TYPE_NEGCON,
+	PSXPAD_KEYSTATE_TYPE_MOUSE,
+	PSXPAD_KEYSTATE_TYPE_UNKNOWN
+};
+
+struct PSXPad_KeyState {
+	int vType;
+	/* PSXPAD_KEYSTATE_DIGITAL */
+	uint8_t bSel;
+	uint8_t bStt;
+	uint8_t bU;
+	uint8_t bR;
+	uint8_t bD;
+	uint8_t bL;
+	uint8_t bL2;
+	uint8_t bR2;
+	uint8_t bL1;
+	uint8_t bR1;
+	uint8_t bTri;
+	uint8_t bCir;
+	uint8_t bCrs;
+	uint8_t bSqr;
+	/* PSXPAD_KEYSTATE_ANALOG1 */
+	uint8_t bL3;
+	uint8_t bR3;
+	uint8_t u8RX;
+	uint8_t u8RY;
+	uint8_t u8LX;
+	uint8_t u8LY;
+	/* PSXPAD_KEYSTATE_ANALOG2 */
+	uint8_t u8AR;
+	uint8_t u8AL;
+	uint8_t u8AU;
+	uint8_t u8AD;
+	uint8_t u8ATri;
+	uint8_t u8ACir;
+	uint8_t u8ACrs;
+	uint8_t u8ASqr;
+	uint8_t u8AL1;
+	uint8_t u8AR1;
+	uint8_t u8AL2;
+	uint8_t u8AR2;
+};
+
+/*
+ * the same state packed for copying and comparing: u16Buttons has a bit
+ * set per pressed button in frame order (PSXPAD_BUTTON_*), lu8Axis is RX,
+ * RY, LX, LY and lu8Pressure R, L, U, D, Tri, Cir, Crs, Sqr, L1, R1, L2, R2;
+ * unused bytes are 0, so equal states compare equal as a whole
+ */
+enum {
+	PSXPAD_BUTTON_SEL = 1 << 0,
+	PSXPAD_BUTTON_L3  = 1 << 1,
+	PSXPAD_BUTTON_R3  = 1 << 2,
+	PSXPAD_BUTTON_STT = 1 << 3,
+	PSXPAD_BUTTON_U   = 1 << 4,
+	PSXPAD_BUTTON_R   = 1 << 5,
+	PSXPAD_BUTTON_D   = 1 << 6,
+	PSXPAD_BUTTON_L   = 1 << 7,
+	PSXPAD_BUTTON_L2  = 1 << 8,
+	PSXPAD_BUTTON_R2  = 1 << 9,
+	PSXPAD_BUTTON_L1  = 1 << 10,
+	PSXPAD_BUTTON_R1  = 1 << 11,
+	PSXPAD_BUTTON_TRI = 1 << 12,
+	PSXPAD_BUTTON_CIR = 1 << 13,
+	PSXPAD_BUTTON_CRS = 1 << 14,
+	PSXPAD_BUTTON_SQR = 1 << 15
+};
+
+struct PSXPad_PackedState {
+	uint16_t u16Buttons;
+	uint8_t u8Type;		/* PSXPAD_KEYSTATE_TYPE_* */
+	uint8_t u8Reserved;
+	uint8_t lu8Axis[4];
+	uint8_t lu8Pressure[12];
+	uint8_t lu8Reserved[4];
+} __attribute__((aligned(8)));
+
+static inline uint16_t PSXPad_Pressed(const struct PSXPad_PackedState *ptLast, const struct PSXPad_PackedState *ptState)
+{
+	return ptState->u16Buttons & ~ptLast->u16Buttons;
+}
+
+static inline uint16_t PSXPad_Released(const struct PSXPad_PackedState *ptLast, const struct PSXPad_PackedState *ptState)
+{
+	return ptLast->u16Buttons & ~ptState->u16Buttons;
+}
+
+/* three 64-bit compares once inlined */
+static inline int PSXPad_PackedEqual(const struct PSXPad_PackedState *ptA, const struct PSXPad_PackedState *ptB)
+{
+	return memcmp(ptA, ptB, sizeof(*ptA)) == 0;
+}
+
+/* opaque, one per transport (spidev device, GPIO lines, emulator); nothing is shared between handles */
+struct PSXPads;
+
+/*
+ * transport, how frames get to the pads and back. fnMSBFirst may be NULL,
+ * else it tells once at init whether a pad is shifted MSB first; what is
+ * sent is then already bit-reversed (the poll frame is kept that way) and
+ * goes out as is, responses come back in protocol order either way.
+ * fnTransfer clocks one frame with attention on pad u8PadNo. fnPoll may be
+ * NULL, else it clocks the poll frames of i_u8Num pads, in the order of
+ * i_lu8PadNo, in one go. fnClose may be NULL, PSXPads_Uninit() calls it.
+ * libpsxpad_gpio.h and libpsxpad_emu.h have the other two transports.
+ */
+struct PSXPads_Transport {
+	int (*fnTransfer)(void *pvCtx, const uint8_t u8PadNo, const uint8_t i_lu8Send[], uint8_t o_lu8Response[], const uint8_t i_u8Len);
+	int (*fnPoll)(void *pvCtx, const uint8_t i_u8Num, const uint8_t i_lu8PadNo[], const uint8_t *const i_lpu8Send[], uint8_t *const o_lpu8Response[], const uint8_t i_lu8Len[]);
+	void (*fnClose)(void *pvCtx);
+	uint8_t (*fnMSBFirst)(void *pvCtx, const uint8_t u8PadNo);
+};
+
+/*
+ * called from PSXPads_Dispatch() for every pad (and multitap port) whose
+ * frame changed; a pad that is unplugged reports PSXPAD_KEYSTATE_TYPE_UNKNOWN
+ */
+typedef void (*PSXPads_Callback)(struct PSXPads *ptPSXPads, const uint8_t u8PadNo, const uint8_t u8Port, const struct PSXPad_PackedState *ptState, void *pvUser);
+
+/* functions returning int give 0 on success, -1 with errno set on failure */
+/*
+ * a spidev device is one chip select: pad 0 is i_strDevice (/dev/spidevB.C),
+ * pad n is /dev/spidevB.C+n; each pad is a message of its own every poll
+ */
+struct PSXPads *PSXPads_Init(const char i_strDevice[], const uint8_t i_u8PadNum);
+struct PSXPads *PSXPads_InitTransport(const struct PSXPads_Transport *i_ptTransport, void *pvCtx, const uint8_t i_u8PadNum);
+void PSXPads_Uninit(struct PSXPads *ptPSXPads);
+
+/*
+ * record and replay (libpsxpad_trace.h has the format): PSXPads_SetRecord()
+ * appends every poll cycle to a trace until it is called with NULL;
+ * PSXPads_InitReplay() gives a handle that polls from a trace instead,
+ * at the recorded pace or, i_bRealTime 0, as fast as it decodes
+ */
+struct PSXPads *PSXPads_InitReplay(const char i_strTrace[], const uint8_t i_bRealTime);
+int PSXPads_SetRecord(struct PSXPads *ptPSXPads, const char i_strTrace[]);
+/* pads of the handle, those of the trace when replaying */
+int PSXPads_GetPadsNum(const struct PSXPads *ptPSXPads);
+
+int PSXPads_Command(struct PSXPads *ptPSXPads, const uint8_t u8PadNo, const uint8_t i_lu8SendCmd[], uint8_t o_lu8Response[], const uint8_t i_u8SendCmdLen);
+int PSXPads_Pool(struct PSXPads *ptPSXPads);
+int PSXPads_DetectMultitap(struct PSXPads *ptPSXPads, const uint8_t u8PadNo);
+int PSXPads_SetADMode(struct PSXPads *ptPSXPads, const uint8_t u8PadNo, const uint8_t i_bAnalog, const uint8_t i_bLock);
+/* DualShock 2 pressure bytes, 12 more per poll; after PSXPads_SetADMode() */
+int PSXPads_SetPressure(struct PSXPads *ptPSXPads, const uint8_t u8PadNo, const uint8_t i_bPressure);
+int PSXPads_SetEnableMotor(struct PSXPads *ptPSXPads, const uint8_t u8PadNo, const uint8_t i_bMotor1Enable, const uint8_t i_bMotor2Enable);
+int PSXPads_SetMotorLevel(struct PSXPads *ptPSXPads, const uint8_t u8PadNo, const uint8_t i_u8Motor1Level, const uint8_t i_u8Motor2Level);
+
+int PSXPads_GetKeyState(struct PSXPads *ptPSXPads, const uint8_t u8PadNo, struct PSXPad_KeyState *o_ptKeyState);
+int PSXPads_GetTapKeyState(struct PSXPads *ptPSXPads, const uint8_t u8PadNo, const uint8_t u8Port, struct PSXPad_KeyState *o_ptKeyState);
+/*
+ * packed state of a pad, or of a port behind a multitap (port 0 without
+ * one); PSXPads_GetPackedStates() decodes every pad and port in one call
+ */
+int PSXPads_GetPackedState(struct PSXPads *ptPSXPads, const uint8_t u8PadNo, const uint8_t u8Port, struct PSXPad_PackedState *o_ptState);
+int PSXPads_GetPackedStates(struct PSXPads *ptPSXPads, struct PSXPad_PackedState o_ltState[][PSXPAD_TAP_PORTS]);
+/* last raw frame of a pad in protocol order, o_pu8Len gets its length */
+const uint8_t *PSXPads_GetFrame(struct PSXPads *ptPSXPads, const uint8_t u8PadNo, uint8_t *o_pu8Len);
+
+uint32_t PSXPads_PoolInterval(struct PSXPads *ptPSXPads);
+void PSXPads_SetPoolInterval(struct PSXPads *ptPSXPads, const uint32_t i_u32IntervalUs);
+void PSXPads_SetIdleTimeout(struct PSXPads *ptPSXPads, const uint32_t i_u32IdleTimeoutMs);
+
+/*
+ * event loop: PSXPads_GetFD() is a timerfd armed for the next absolute poll
+ * deadline, add it to an epoll set (EPOLLIN) and call PSXPads_Dispatch()
+ * when it is readable; or let PSXPads_Run() block until PSXPads_Stop()
+ */
+int PSXPads_SetCallback(struct PSXPads *ptPSXPads, PSXPads_Callback i_fnCallback, void *i_pvUser);
+int PSXPads_GetFD(const struct PSXPads *ptPSXPads);
+int PSXPads_Dispatch(struct PSXPads *ptPSXPads);
+int PSXPads_Run(struct PSXPads *ptPSXPads);
+void PSXPads_Stop(struct PSXPads *ptPSXPads);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBPSXPAD_H */
@@ -0,0 +1,460 @@
+/*
+ * PSX(Play Station 1/2) pad emulator (libpsxpad transport)
+ *
+ * Copyright (c) 2017 AZO
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "libpsxpad.h"
+#include "libpsxpad_emu.h"
+
+/* multitap frame: 0x80, 0x5A and 4 slots of ID, 0x5A, 6 data bytes */
+#define PSXPADEMU_TAP_FRAME_LEN	35
+#define PSXPADEMU_TAP_SLOT_LEN	8
+
+/* the motor mapping of 0x4D: which poll byte drives which motor */
+#define PSXPADEMU_MOTOR_SMALL	0x00
+#define PSXPADEMU_MOTOR_LARGE	0x01
+#define PSXPADEMU_MOTOR_NONE	0xFF
+
+struct PSXPadEmu_Pad {
+	int vType;
+	uint8_t bAnalog;
+	uint8_t bLock;
+	uint8_t bConfig;
+	uint8_t bPressure;
+	uint8_t lu8MotorMap[6];	/* poll bytes 3-8 */
+	uint8_t u8Small;
+	uint8_t u8Large;
+	struct PSXPad_PackedState tState;
+};
+
+struct PSXPadEmu_Socket {
+	uint8_t bMultitap;
+	uint32_t lu32Error[PSXPADEMU_ERROR_NUM];
+	struct PSXPadEmu_Pad ltPort[PSXPAD_TAP_PORTS];
+};
+
+struct PSXPadEmu {
+	uint8_t u8PadsNum;
+	uint32_t u32SpeedHz;
+	uint32_t u32ByteGapUs;
+	PSXPadEmu_SampleHook fnHook;
+	void *pvUser;
+	uint32_t u32Random;	/* which bit a corruption flips */
+	uint64_t u64Transfers;
+	uint64_t u64Bytes;
+	struct PSXPadEmu_Socket ltSocket[PSXPAD_MAXPADNUM];
+};
+
+static struct PSXPadEmu_Pad *PSXPadEmu_GetPad(const struct PSXPadEmu *ptEmu, const uint8_t u8PadNo, const uint8_t u8Port)
+{
+	if (!ptEmu || u8PadNo >= ptEmu->u8PadsNum || u8Port >= PSXPAD_TAP_PORTS) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	return (struct PSXPadEmu_Pad *)&(ptEmu->ltSocket[u8PadNo].ltPort[u8Port]);
+}
+
+/* as after power-on: digital, out of config, motors unmapped */
+static void PSXPadEmu_Reset(struct PSXPadEmu_Pad *ptPad)
+{
+	ptPad->bAnalog = 0;
+	ptPad->bLock = 0;
+	ptPad->bConfig = 0;
+	ptPad->bPressure = 0;
+	memset(ptPad->lu8MotorMap, PSXPADEMU_MOTOR_NONE, sizeof(ptPad->lu8MotorMap));
+	ptPad->u8Small = 0;
+	ptPad->u8Large = 0;
+}
+
+struct PSXPadEmu *PSXPadEmu_Create(const uint8_t i_u8PadsNum)
+{
+	struct PSXPadEmu *ptEmu;
+	uint8_t u8PadNo, u8Port;
+
+	if (i_u8PadsNum == 0 || i_u8PadsNum > PSXPAD_MAXPADNUM) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	ptEmu = calloc(1, sizeof(*ptEmu));
+	if (!ptEmu)
+		return NULL;
+	ptEmu->u8PadsNum = i_u8PadsNum;
+	ptEmu->u32Random = 1;
+
+	for (u8PadNo = 0; u8PadNo < PSXPAD_MAXPADNUM; u8PadNo++) {
+		for (u8Port = 0; u8Port < PSXPAD_TAP_PORTS; u8Port++) {
+			ptEmu->ltSocket[u8PadNo].ltPort[u8Port].vType = PSXPADEMU_TYPE_NONE;
+			memset(ptEmu->ltSocket[u8PadNo].ltPort[u8Port].tState.lu8Axis, 0x80, sizeof(ptEmu->ltSocket[u8PadNo].ltPort[u8Port].tState.lu8Axis));
+			PSXPadEmu_Reset(&(ptEmu->ltSocket[u8PadNo].ltPort[u8Port]));
+		}
+	}
+
+	return ptEmu;
+}
+
+void PSXPadEmu_Destroy(struct PSXPadEmu *ptEmu)
+{
+	free(ptEmu);
+}
+
+int PSXPadEmu_Plug(struct PSXPadEmu *ptEmu, const uint8_t u8PadNo, const uint8_t u8Port, const int i_vType)
+{
+	struct PSXPadEmu_Pad *ptPad = PSXPadEmu_GetPad(ptEmu, u8PadNo, u8Port);
+
+	if (!ptPad)
+		return -1;
+	if (i_vType < PSXPADEMU_TYPE_NONE || i_vType > PSXPADEMU_TYPE_DUALSHOCK2) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	ptPad->vType = i_vType;
+	PSXPadEmu_Reset(ptPad);
+
+	return 0;
+}
+
+int PSXPadEmu_SetMultitap(struct PSXPadEmu *ptEmu, const uint8_t u8PadNo, const uint8_t i_bMultitap)
+{
+	if (!PSXPadEmu_GetPad(ptEmu, u8PadNo, 0))
+		return -1;
+
+	ptEmu->ltSocket[u8PadNo].bMultitap = i_bMultitap ? 1 : 0;
+
+	return 0;
+}
+
+int PSXPadEmu_SetState(struct PSXPadEmu *ptEmu, const uint8_t u8PadNo, const uint8_t u8Port, const struct PSXPad_PackedState *i_ptState)
+{
+	struct PSXPadEmu_Pad *ptPad = PSXPadEmu_GetPad(ptEmu, u8PadNo, u8Port);
+
+	if (!ptPad)
+		return -1;
+	if (!i_ptState) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	ptPad->tState = *i_ptState;
+
+	return 0;
+}
+
+static uint8_t PSXPadEmu_Mode(const struct PSXPadEmu_Pad *ptPad)
+{
+	if (ptPad->vType == PSXPADEMU_TYPE_NONE)
+		return 0xFF;
+	if (ptPad->bConfig)
+		return 0xF3;
+	if (!ptPad->bAnalog)
+		return 0x41;
+
+	return ptPad->bPressure ? 0x79 : 0x73;
+}
+
+int PSXPadEmu_GetMode(const struct PSXPadEmu *ptEmu, const uint8_t u8PadNo, const uint8_t u8Port, uint8_t *o_pu8Mode)
+{
+	const struct PSXPadEmu_Pad *ptPad = PSXPadEmu_GetPad(ptEmu, u8PadNo, u8Port);
+
+	if (!ptPad)
+		return -1;
+	if (!o_pu8Mode) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	*o_pu8Mode = PSXPadEmu_Mode(ptPad);
+
+	return 0;
+}
+
+int PSXPadEmu_GetMotor(const struct PSXPadEmu *ptEmu, const uint8_t u8PadNo, const uint8_t u8Port, uint8_t *o_pu8Small, uint8_t *o_pu8Large)
+{
+	const struct PSXPadEmu_Pad *ptPad = PSXPadEmu_GetPad(ptEmu, u8PadNo, u8Port);
+
+	if (!ptPad)
+		return -1;
+
+	if (o_pu8Small)
+		*o_pu8Small = ptPad->u8Small;
+	if (o_pu8Large)
+		*o_pu8Large = ptPad->u8Large;
+
+	return 0;
+}
+
+int PSXPadEmu_InjectError(struct PSXPadEmu *ptEmu, const uint8_t u8PadNo, const int i_vError, const uint32_t i_u32Count)
+{
+	if (!PSXPadEmu_GetPad(ptEmu, u8PadNo, 0))
+		return -1;
+	if (i_vError < 0 || i_vError >= PSXPADEMU_ERROR_NUM) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	ptEmu->ltSocket[u8PadNo].lu32Error[i_vError] = i_u32Count;
+
+	return 0;
+}
+
+int PSXPadEmu_SetSampleHook(struct PSXPadEmu *ptEmu, PSXPadEmu_SampleHook i_fnHook, void *i_pvUser)
+{
+	if (!ptEmu) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	ptEmu->fnHook = i_fnHook;
+	ptEmu->pvUser = i_pvUser;
+
+	return 0;
+}
+
+int PSXPadEmu_SetBusSpeed(struct PSXPadEmu *ptEmu, const uint32_t i_u32SpeedHz, const uint32_t i_u32ByteGapUs)
+{
+	if (!ptEmu) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	ptEmu->u32SpeedHz = i_u32SpeedHz;
+	ptEmu->u32ByteGapUs = i_u32ByteGapUs;
+
+	return 0;
+}
+
+int PSXPadEmu_GetStats(const struct PSXPadEmu *ptEmu, uint64_t *o_pu64Transfers, uint64_t *o_pu64Bytes)
+{
+	if (!ptEmu) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (o_pu64Transfers)
+		*o_pu64Transfers = ptEmu->u64Transfers;
+	if (o_pu64Bytes)
+		*o_pu64Bytes = ptEmu->u64Bytes;
+
+	return 0;
+}
+
+/* data bytes of a poll answer: inverted buttons, RX RY LX LY, 12 pressures */
+static uint8_t PSXPadEmu_Input(const struct PSXPadEmu_Pad *ptPad, uint8_t o_lu8Data[])
+{
+	o_lu8Data[0] = ~ptPad->tState.u16Buttons;
+	o_lu8Data[1] = ~ptPad->tState.u16Buttons >> 8;
+	if (!ptPad->bAnalog)
+		return 2;
+
+	memcpy(&o_lu8Data[2], ptPad->tState.lu8Axis, sizeof(ptPad->tState.lu8Axis));
+	if (!ptPad->bPressure)
+		return 6;
+
+	memcpy(&o_lu8Data[6], ptPad->tState.lu8Pressure, sizeof(ptPad->tState.lu8Pressure));
+	return 18;
+}
+
+/*
+ * one frame of a pad: i_lu8Send[0] addresses the pad, [1] is the command.
+ * the mode ID is the one before the command takes effect, like the pad
+ * that answers while it is still receiving. bytes past the pad's answer
+ * read 0xFF, DAT is pulled up.
+ */
+static void PSXPadEmu_Frame(struct PSXPadEmu *ptEmu, const uint8_t u8PadNo, const uint8_t u8Port, const uint8_t i_lu8Send[], uint8_t o_lu8Response[], const uint8_t i_u8Len)
+{
+	struct PSXPadEmu_Pad *ptPad = &(ptEmu->ltSocket[u8PadNo].ltPort[u8Port]);
+	uint8_t lu8Data[18], lu8Cmd[6];
+	uint8_t u8DataLen = 6, u8Loc;
+
+	memset(o_lu8Response, 0xFF, i_u8Len);
+	if (ptPad->vType == PSXPADEMU_TYPE_NONE || i_u8Len < 3 || i_lu8Send[0] != 0x01)
+		return;
+
+	/* command bytes past the transfer are never received */
+	for (u8Loc = 0; u8Loc < sizeof(lu8Cmd); u8Loc++)
+		lu8Cmd[u8Loc] = (3 + u8Loc < i_u8Len) ? i_lu8Send[3 + u8Loc] : 0x00;
+
+	o_lu8Response[1] = PSXPadEmu_Mode(ptPad);
+	o_lu8Response[2] = 0x5A;
+	memset(lu8Data, 0x00, sizeof(lu8Data));
+
+	if (!ptPad->bConfig) {
+		/* out of config mode every command is a poll, 0x43 may also enter it */
+		if (ptEmu->fnHook)
+			ptEmu->fnHook(ptEmu, u8PadNo, u8Port, ptEmu->pvUser);
+		u8DataLen = PSXPadEmu_Input(ptPad, lu8Data);
+
+		if (i_lu8Send[1] == 0x42) {
+			for (u8Loc = 0; u8Loc < sizeof(lu8Cmd); u8Loc++) {
+				if (ptPad->lu8MotorMap[u8Loc] == PSXPADEMU_MOTOR_SMALL)
+					ptPad->u8Small = lu8Cmd[u8Loc];
+				else if (ptPad->lu8MotorMap[u8Loc] == PSXPADEMU_MOTOR_LARGE)
+					ptPad->u8Large = lu8Cmd[u8Loc];
+			}
+		}
+		if (i_lu8Send[1] == 0x43 && lu8Cmd[0] == 0x01 && ptPad->vType != PSXPADEMU_TYPE_DIGITAL)
+			ptPad->bConfig = 1;
+	} else {
+		switch (i_lu8Send[1]) {
+		case 0x42:
+			if (ptEmu->fnHook)
+				ptEmu->fnHook(ptEmu, u8PadNo, u8Port, ptEmu->pvUser);
+			PSXPadEmu_Input(ptPad, lu8Data);
+			break;
+		case 0x43:
+			if (lu8Cmd[0] == 0x00)
+				ptPad->bConfig = 0;
+			break;
+		case 0x44:
+			ptPad->bAnalog = (lu8Cmd[0] == 0x01) ? 1 : 0;
+			ptPad->bLock = (lu8Cmd[1] == 0x03) ? 1 : 0;
+			if (!ptPad->bAnalog)
+				ptPad->bPressure = 0;
+			break;
+		case 0x45:
+			/* model, LED (analog), two actuators */
+			lu8Data[0] = (ptPad->vType == PSXPADEMU_TYPE_DUALSHOCK2) ? 0x03 : 0x01;
+			lu8Data[1] = 0x02;
+			lu8Data[2] = ptPad->bAnalog;
+			lu8Data[3] = 0x02;
+			lu8Data[4] = 0x01;
+			break;
+		case 0x4D:
+			memcpy(lu8Data, ptPad->lu8MotorMap, sizeof(ptPad->lu8MotorMap));
+			memcpy(ptPad->lu8MotorMap, lu8Cmd, sizeof(ptPad->lu8MotorMap));
+			break;
+		case 0x4F:
+			/*
+			 * bytes 3-5 select the response bytes, only a DualShock 2
+			 * has them; the first six are buttons and sticks, 0x79
+			 * only once a pressure byte is selected
+			 */
+			if (ptPad->vType == PSXPADEMU_TYPE_DUALSHOCK2 && ptPad->bAnalog)
+				ptPad->bPressure = ((lu8Cmd[0] & 0xC0) | lu8Cmd[1] | (lu8Cmd[2] & 0x03)) ? 1 : 0;
+			lu8Data[5] = 0x5A;
+			break;
+		default:
+			/* 0x40, 0x41, 0x46, 0x47, 0x4C: nothing the poll depends on */
+			break;
+		}
+	}
+
+	for (u8Loc = 0; u8Loc < u8DataLen && 3 + u8Loc < i_u8Len; u8Loc++)
+		o_lu8Response[3 + u8Loc] = lu8Data[u8Loc];
+}
+
+/* each port is polled as on its own, its answer goes to a slot without the HiZ byte */
+static void PSXPadEmu_TapFrame(struct PSXPadEmu *ptEmu, const uint8_t u8PadNo, uint8_t o_lu8Response[], const uint8_t i_u8Len)
+{
+	static const uint8_t lu8Poll[3 + PSXPADEMU_TAP_SLOT_LEN - 2] = {0x01, 0x42};
+	uint8_t lu8Frame[PSXPADEMU_TAP_FRAME_LEN];
+	uint8_t lu8Slot[1 + PSXPADEMU_TAP_SLOT_LEN];
+	uint8_t u8Port;
+
+	memset(lu8Frame, 0xFF, sizeof(lu8Frame));
+	lu8Frame[1] = 0x80;
+	lu8Frame[2] = 0x5A;
+	for (u8Port = 0; u8Port < PSXPAD_TAP_PORTS; u8Port++) {
+		PSXPadEmu_Frame(ptEmu, u8PadNo, u8Port, lu8Poll, lu8Slot, sizeof(lu8Slot));
+		memcpy(&lu8Frame[3 + u8Port * PSXPADEMU_TAP_SLOT_LEN], &lu8Slot[1], PSXPADEMU_TAP_SLOT_LEN);
+	}
+
+	memcpy(o_lu8Response, lu8Frame, (i_u8Len < sizeof(lu8Frame)) ? i_u8Len : sizeof(lu8Frame));
+}
+
+/* spends the time the frame would take on the wire */
+static void PSXPadEmu_Wire(const struct PSXPadEmu *ptEmu, const uint8_t i_u8Len)
+{
+	struct timespec tDone;
+	uint64_t u64Ns;
+
+	if (ptEmu->u32SpeedHz == 0)
+		return;
+
+	u64Ns = (uint64_t)i_u8Len * 8 * 1000000000 / ptEmu->u32SpeedHz + (uint64_t)i_u8Len * ptEmu->u32ByteGapUs * 1000;
+	clock_gettime(CLOCK_MONOTONIC, &tDone);
+	tDone.tv_sec += u64Ns / 1000000000;
+	tDone.tv_nsec += u64Ns % 1000000000;
+	if (tDone.tv_nsec >= 1000000000) {
+		tDone.tv_sec++;
+		tDone.tv_nsec -= 1000000000;
+	}
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &tDone, NULL) == EINTR)
+		;
+}
+
+static int PSXPadEmu_Transfer(void *pvCtx, const uint8_t u8PadNo, const uint8_t i_lu8Send[], uint8_t o_lu8Response[], const uint8_t i_u8Len)
+{
+	struct PSXPadEmu *ptEmu = pvCtx;
+	struct PSXPadEmu_Socket *ptSocket;
+	uint32_t u32Bit;
+	uint8_t u8Port;
+
+	if (u8PadNo >= ptEmu->u8PadsNum) {
+		errno = EINVAL;
+		return -1;
+	}
+	ptSocket = &(ptEmu->ltSocket[u8PadNo]);
+
+	if (ptSocket->lu32Error[PSXPADEMU_ERROR_TRANSFER]) {
+		ptSocket->lu32Error[PSXPADEMU_ERROR_TRANSFER]--;
+		errno = EIO;
+		return -1;
+	}
+	if (ptSocket->lu32Error[PSXPADEMU_ERROR_RESET]) {
+		ptSocket->lu32Error[PSXPADEMU_ERROR_RESET]--;
+		for (u8Port = 0; u8Port < PSXPAD_TAP_PORTS; u8Port++)
+			PSXPadEmu_Reset(&(ptSocket->ltPort[u8Port]));
+	}
+
+	/* a multitap answers the multitap poll itself and passes anything else to port A */
+	if (ptSocket->bMultitap && i_u8Len >= 3 && i_lu8Send[0] == 0x01 && i_lu8Send[1] == 0x42 && i_lu8Send[2] == 0x01)
+		PSXPadEmu_TapFrame(ptEmu, u8PadNo, o_lu8Response, i_u8Len);
+	else
+		PSXPadEmu_Frame(ptEmu, u8PadNo, 0, i_lu8Send, o_lu8Response, i_u8Len);
+
+	if (ptSocket->lu32Error[PSXPADEMU_ERROR_NOMARKER]) {
+		ptSocket->lu32Error[PSXPADEMU_ERROR_NOMARKER]--;
+		memset(o_lu8Response, 0xFF, i_u8Len);
+	}
+	if (ptSocket->lu32Error[PSXPADEMU_ERROR_CORRUPT] && i_u8Len > 1) {
+		ptSocket->lu32Error[PSXPADEMU_ERROR_CORRUPT]--;
+		/* any bit but those of the HiZ byte */
+		ptEmu->u32Random = ptEmu->u32Random * 1103515245 + 12345;
+		u32Bit = (ptEmu->u32Random >> 8) % ((i_u8Len - 1) * 8);
+		o_lu8Response[1 + u32Bit / 8] ^= 1 << (u32Bit % 8);
+	}
+
+	ptEmu->u64Transfers++;
+	ptEmu->u64Bytes += i_u8Len;
+	PSXPadEmu_Wire(ptEmu, i_u8Len);
+
+	return 0;
+}
+
+static const struct PSXPads_Transport tPSXPadEmu_Transport = {
+	.fnTransfer	= PSXPadEmu_Transfer
+};
+
+struct PSXPads *PSXPads_InitEmu(struct PSXPadEmu *ptEmu)
+{
+	if (!ptEmu) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	return PSXPads_InitTransport(&tPSXPadEmu_Transport, ptEmu, ptEmu->u8PadsNum);
+}
@@ -0,0 +1,84 @@
+/*
+ * PSX(Play Station 1/2) pad emulator (libpsxpad transport)
+ *
+ * Copyright (c) 2017 AZO
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License.
+ */
+
+#ifndef LIBPSXPAD_EMU_H
+#define LIBPSXPAD_EMU_H
+
+#include <stdint.h>
+
+#include "libpsxpad.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * pads answering the PSX protocol in process, behind the same poll, config
+ * and decode code as real ones: digital, analog and pressure modes, config
+ * mode, the motor mapping of 0x4D, a multitap in any socket, and faults
+ * injected into the next transfers. nothing runs in the background, a pad
+ * only changes when the caller or a transfer changes it.
+ */
+struct PSXPadEmu;
+
+/* what is plugged into a socket, or into a port of a multitap there */
+enum {
+	PSXPADEMU_TYPE_NONE = 0,
+	PSXPADEMU_TYPE_DIGITAL,		/* SCPH-1080: 0x41 only, no config mode */
+	PSXPADEMU_TYPE_DUALSHOCK,	/* 0x41/0x73, config mode, two motors */
+	PSXPADEMU_TYPE_DUALSHOCK2	/* as DualShock, and 0x79 with pressure */
+};
+
+/* faults, each for a number of the next transfers of a socket */
+enum {
+	PSXPADEMU_ERROR_TRANSFER = 0,	/* the transfer fails with EIO */
+	PSXPADEMU_ERROR_NOMARKER,	/* nothing answers, all 0xFF */
+	PSXPADEMU_ERROR_CORRUPT,	/* one bit of the response flips */
+	PSXPADEMU_ERROR_RESET,		/* the pads forget their mode and config */
+	PSXPADEMU_ERROR_NUM
+};
+
+/* called when a pad latches its inputs, just before it answers with them */
+typedef void (*PSXPadEmu_SampleHook)(struct PSXPadEmu *ptEmu, const uint8_t u8PadNo, const uint8_t u8Port, void *pvUser);
+
+/* functions returning int give 0 on success, -1 with errno set on failure */
+struct PSXPadEmu *PSXPadEmu_Create(const uint8_t i_u8PadsNum);
+void PSXPadEmu_Destroy(struct PSXPadEmu *ptEmu);
+
+/* port 0 without a multitap; a pad plugged in starts digital, unconfigured */
+int PSXPadEmu_Plug(struct PSXPadEmu *ptEmu, const uint8_t u8PadNo, const uint8_t u8Port, const int i_vType);
+int PSXPadEmu_SetMultitap(struct PSXPadEmu *ptEmu, const uint8_t u8PadNo, const uint8_t i_bMultitap);
+
+/* buttons, sticks and pressure the pad reports from its next sample on, u8Type is ignored */
+int PSXPadEmu_SetState(struct PSXPadEmu *ptEmu, const uint8_t u8PadNo, const uint8_t u8Port, const struct PSXPad_PackedState *i_ptState);
+/* mode ID the pad answers with now, 0xFF without a pad */
+int PSXPadEmu_GetMode(const struct PSXPadEmu *ptEmu, const uint8_t u8PadNo, const uint8_t u8Port, uint8_t *o_pu8Mode);
+/* motor bytes the last poll drove through the motor mapping */
+int PSXPadEmu_GetMotor(const struct PSXPadEmu *ptEmu, const uint8_t u8PadNo, const uint8_t u8Port, uint8_t *o_pu8Small, uint8_t *o_pu8Large);
+
+int PSXPadEmu_InjectError(struct PSXPadEmu *ptEmu, const uint8_t u8PadNo, const int i_vError, const uint32_t i_u32Count);
+int PSXPadEmu_SetSampleHook(struct PSXPadEmu *ptEmu, PSXPadEmu_SampleHook i_fnHook, void *i_pvUser);
+
+/*
+ * a transfer takes as long as on the wire at this clock, with a gap of
+ * i_u32ByteGapUs after each byte (the ACK pulse); 0 Hz returns right away
+ */
+int PSXPadEmu_SetBusSpeed(struct PSXPadEmu *ptEmu, const uint32_t i_u32SpeedHz, const uint32_t i_u32ByteGapUs);
+/* transfers and bytes clocked so far */
+int PSXPadEmu_GetStats(const struct PSXPadEmu *ptEmu, uint64_t *o_pu64Transfers, uint64_t *o_pu64Bytes);
+
+/* a libpsxpad handle on the emulator's sockets; the emulator must outlive it */
+struct PSXPads *PSXPads_InitEmu(struct PSXPadEmu *ptEmu);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBPSXPAD_EMU_H */
@@ -0,0 +1,272 @@
+/*
+ * PSX(Play Station 1/2) pad GPIO bit-bang transport (using gpiochip)
+ *
+ * Copyright (c) 2017 AZO
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+
+#include "libpsxpad.h"
+#include "libpsxpad_gpio.h"
+
+/* bits of the output request, attention lines follow */
+#define PSXPADGPIO_OUT_CLK	0
+#define PSXPADGPIO_OUT_CMD	1
+#define PSXPADGPIO_OUT_ATT	2
+/* bits of the input request */
+#define PSXPADGPIO_IN_DAT	0
+#define PSXPADGPIO_IN_ACK	1
+
+#define PSXPADGPIO_SPEED_HZ	125000
+/* attention to first clock, and between bytes without an ACK line */
+#define PSXPADGPIO_GAP_NS	20000
+/* a pad pulls ACK within a few us of a byte, none at all after its last */
+#define PSXPADGPIO_ACK_TIMEOUT_NS	100000
+
+struct PSXPadGPIO {
+	int iOutFD;
+	int iInFD;
+	uint8_t bAck;
+	uint8_t u8PadsNum;
+	long lHalfNs;	/* half a clock period */
+};
+
+static void PSXPadGPIO_Advance(struct timespec *io_ptTime, const long i_lNs)
+{
+	io_ptTime->tv_nsec += i_lNs;
+	while (io_ptTime->tv_nsec >= 1000000000) {
+		io_ptTime->tv_sec++;
+		io_ptTime->tv_nsec -= 1000000000;
+	}
+}
+
+static int PSXPadGPIO_Before(const struct timespec *i_ptA, const struct timespec *i_ptB)
+{
+	if (i_ptA->tv_sec != i_ptB->tv_sec)
+		return i_ptA->tv_sec < i_ptB->tv_sec;
+
+	return i_ptA->tv_nsec < i_ptB->tv_nsec;
+}
+
+/*
+ * edges are timed against an absolute deadline advanced by half a period,
+ * so the ioctl time is part of the period instead of stretching it; a
+ * few us are too short to sleep, it spins
+ */
+static void PSXPadGPIO_Wait(struct timespec *io_ptDeadline, const long i_lNs)
+{
+	struct timespec tNow;
+
+	PSXPadGPIO_Advance(io_ptDeadline, i_lNs);
+	do {
+		clock_gettime(CLOCK_MONOTONIC, &tNow);
+	} while (PSXPadGPIO_Before(&tNow, io_ptDeadline));
+}
+
+static int PSXPadGPIO_Set(const struct PSXPadGPIO *ptGPIO, const uint64_t i_u64Bits, const uint64_t i_u64Mask)
+{
+	struct gpio_v2_line_values tValues;
+
+	tValues.bits = i_u64Bits;
+	tValues.mask = i_u64Mask;
+
+	return ioctl(ptGPIO->iOutFD, GPIO_V2_LINE_SET_VALUES_IOCTL, &tValues);
+}
+
+static int PSXPadGPIO_Get(const struct PSXPadGPIO *ptGPIO, uint64_t *o_pu64Bits)
+{
+	struct gpio_v2_line_values tValues;
+
+	tValues.bits = 0;
+	tValues.mask = ptGPIO->bAck ? (1 << PSXPADGPIO_IN_DAT) | (1 << PSXPADGPIO_IN_ACK) : (1 << PSXPADGPIO_IN_DAT);
+	if (ioctl(ptGPIO->iInFD, GPIO_V2_LINE_GET_VALUES_IOCTL, &tValues) < 0)
+		return -1;
+	*o_pu64Bits = tValues.bits;
+
+	return 0;
+}
+
+/* false once the pad doesn't ACK, it has no more bytes to send */
+static int PSXPadGPIO_WaitAck(const struct PSXPadGPIO *ptGPIO, struct timespec *io_ptDeadline)
+{
+	struct timespec tTimeout = *io_ptDeadline;
+	uint64_t u64Bits;
+
+	PSXPadGPIO_Advance(&tTimeout, PSXPADGPIO_ACK_TIMEOUT_NS);
+	do {
+		if (PSXPadGPIO_Get(ptGPIO, &u64Bits) < 0)
+			return -1;
+		clock_gettime(CLOCK_MONOTONIC, io_ptDeadline);
+		if (!(u64Bits & (1 << PSXPADGPIO_IN_ACK)))
+			return 1;
+	} while (PSXPadGPIO_Before(io_ptDeadline, &tTimeout));
+
+	return 0;
+}
+
+/* mode 3 and LSB first: CMD changes on the falling edge, DAT is read on the rising one */
+static int PSXPadGPIO_Transfer(void *pvCtx, const uint8_t u8PadNo, const uint8_t i_lu8Send[], uint8_t o_lu8Response[], const uint8_t i_u8Len)
+{
+	struct PSXPadGPIO *ptGPIO = pvCtx;
+	const uint64_t u64Att = 1ULL << (PSXPADGPIO_OUT_ATT + u8PadNo);
+	struct timespec tDeadline;
+	uint64_t u64Bits;
+	uint8_t u8Loc, u8Bit, u8Value, bAcked = ptGPIO->bAck;
+	int ret = 0;
+
+	if (u8PadNo >= ptGPIO->u8PadsNum) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &tDeadline);
+	if (PSXPadGPIO_Set(ptGPIO, 0, u64Att) < 0)
+		return -1;
+	PSXPadGPIO_Wait(&tDeadline, PSXPADGPIO_GAP_NS);
+
+	for (u8Loc = 0; u8Loc < i_u8Len; u8Loc++) {
+		u8Value = 0;
+		for (u8Bit = 0; u8Bit < 8; u8Bit++) {
+			if (PSXPadGPIO_Set(ptGPIO, ((i_lu8Send[u8Loc] >> u8Bit) & 1) << PSXPADGPIO_OUT_CMD, (1 << PSXPADGPIO_OUT_CLK) | (1 << PSXPADGPIO_OUT_CMD)) < 0)
+				goto err;
+			PSXPadGPIO_Wait(&tDeadline, ptGPIO->lHalfNs);
+			if (PSXPadGPIO_Set(ptGPIO, 1 << PSXPADGPIO_OUT_CLK, 1 << PSXPADGPIO_OUT_CLK) < 0 || PSXPadGPIO_Get(ptGPIO, &u64Bits) < 0)
+				goto err;
+			u8Value |= (u64Bits & (1 << PSXPADGPIO_IN_DAT)) ? (1 << u8Bit) : 0;
+			PSXPadGPIO_Wait(&tDeadline, ptGPIO->lHalfNs);
+		}
+		o_lu8Response[u8Loc] = u8Value;
+
+		if (u8Loc + 1 == i_u8Len)
+			break;
+		if (!ptGPIO->bAck) {
+			PSXPadGPIO_Wait(&tDeadline, PSXPADGPIO_GAP_NS);
+		} else if (bAcked) {
+			ret = PSXPadGPIO_WaitAck(ptGPIO, &tDeadline);
+			if (ret < 0)
+				goto err;
+			bAcked = ret;
+		}
+	}
+
+	return PSXPadGPIO_Set(ptGPIO, u64Att, u64Att);
+
+err:
+	PSXPadGPIO_Set(ptGPIO, u64Att, u64Att);
+	return -1;
+}
+
+static void PSXPadGPIO_Close(void *pvCtx)
+{
+	struct PSXPadGPIO *ptGPIO = pvCtx;
+
+	close(ptGPIO->iOutFD);
+	close(ptGPIO->iInFD);
+	free(ptGPIO);
+}
+
+static const struct PSXPads_Transport tPSXPadGPIO_Transport = {
+	.fnTransfer	= PSXPadGPIO_Transfer,
+	.fnClose	= PSXPadGPIO_Close
+};
+
+static int PSXPadGPIO_Request(const int i_iChipFD, const uint32_t i_lu32Offset[], const uint8_t i_u8Num, const uint64_t i_u64Flags)
+{
+	struct gpio_v2_line_request tRequest;
+
+	memset(&tRequest, 0, sizeof(tRequest));
+	memcpy(tRequest.offsets, i_lu32Offset, i_u8Num * sizeof(i_lu32Offset[0]));
+	strncpy(tRequest.consumer, "libpsxpad", sizeof(tRequest.consumer) - 1);
+	tRequest.num_lines = i_u8Num;
+	tRequest.config.flags = i_u64Flags;
+
+	/* outputs start idle: clock, command and attention high */
+	if (i_u64Flags & GPIO_V2_LINE_FLAG_OUTPUT) {
+		tRequest.config.num_attrs = 1;
+		tRequest.config.attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+		tRequest.config.attrs[0].attr.values = (1ULL << i_u8Num) - 1;
+		tRequest.config.attrs[0].mask = (1ULL << i_u8Num) - 1;
+	}
+
+	if (ioctl(i_iChipFD, GPIO_V2_GET_LINE_IOCTL, &tRequest) < 0)
+		return -1;
+
+	return tRequest.fd;
+}
+
+struct PSXPads *PSXPads_InitGPIO(const char i_strChip[], const struct PSXPadGPIO_Lines *i_ptLines, const uint8_t i_u8PadNum, const uint32_t i_u32SpeedHz)
+{
+	struct PSXPads *ptPSXPads;
+	struct PSXPadGPIO *ptGPIO;
+	uint32_t lu32Offset[PSXPADGPIO_OUT_ATT + PSXPAD_MAXPADNUM];
+	uint8_t u8PadNo;
+	int iChipFD, iErrno;
+
+	if (!i_strChip || !i_ptLines || i_u8PadNum == 0 || i_u8PadNum > PSXPAD_MAXPADNUM) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	ptGPIO = calloc(1, sizeof(*ptGPIO));
+	if (!ptGPIO)
+		return NULL;
+	ptGPIO->iOutFD = -1;
+	ptGPIO->iInFD = -1;
+	ptGPIO->bAck = (i_ptLines->i32Ack >= 0) ? 1 : 0;
+	ptGPIO->u8PadsNum = i_u8PadNum;
+	ptGPIO->lHalfNs = 500000000 / (i_u32SpeedHz ? i_u32SpeedHz : PSXPADGPIO_SPEED_HZ);
+
+	iChipFD = open(i_strChip, O_RDWR | O_CLOEXEC);
+	if (iChipFD < 0)
+		goto err_free;
+
+	lu32Offset[PSXPADGPIO_OUT_CLK] = i_ptLines->u32Clk;
+	lu32Offset[PSXPADGPIO_OUT_CMD] = i_ptLines->u32Cmd;
+	for (u8PadNo = 0; u8PadNo < i_u8PadNum; u8PadNo++)
+		lu32Offset[PSXPADGPIO_OUT_ATT + u8PadNo] = i_ptLines->lu32Att[u8PadNo];
+	ptGPIO->iOutFD = PSXPadGPIO_Request(iChipFD, lu32Offset, PSXPADGPIO_OUT_ATT + i_u8PadNum, GPIO_V2_LINE_FLAG_OUTPUT);
+	if (ptGPIO->iOutFD < 0)
+		goto err_close;
+
+	lu32Offset[PSXPADGPIO_IN_DAT] = i_ptLines->u32Dat;
+	lu32Offset[PSXPADGPIO_IN_ACK] = i_ptLines->i32Ack;
+	/* DAT and ACK are open drain on the pad, pulled up here when the chip can bias its lines */
+	ptGPIO->iInFD = PSXPadGPIO_Request(iChipFD, lu32Offset, ptGPIO->bAck ? 2 : 1, GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_BIAS_PULL_UP);
+	if (ptGPIO->iInFD < 0)
+		ptGPIO->iInFD = PSXPadGPIO_Request(iChipFD, lu32Offset, ptGPIO->bAck ? 2 : 1, GPIO_V2_LINE_FLAG_INPUT);
+	if (ptGPIO->iInFD < 0)
+		goto err_close;
+
+	close(iChipFD);
+
+	ptPSXPads = PSXPads_InitTransport(&tPSXPadGPIO_Transport, ptGPIO, i_u8PadNum);
+	if (!ptPSXPads) {
+		iErrno = errno;
+		PSXPadGPIO_Close(ptGPIO);
+		errno = iErrno;
+	}
+
+	return ptPSXPads;
+
+err_close:
+	iErrno = errno;
+	if (ptGPIO->iOutFD >= 0)
+		close(ptGPIO->iOutFD);
+	close(iChipFD);
+	errno = iErrno;
+err_free:
+	free(ptGPIO);
+	return NULL;
+}
@@ -0,0 +1,44 @@
+/*
+ * PSX(Play Station 1/2) pad GPIO bit-bang transport (using gpiochip)
+ *
+ * Copyright (c) 2017 AZO
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License.
+ */
+
+#ifndef LIBPSXPAD_GPIO_H
+#define LIBPSXPAD_GPIO_H
+
+#include <stdint.h>
+
+#include "libpsxpad.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * line offsets on the gpiochip, the pad wired as in psxpad-spi.c;
+ * one attention line per pad. i32Ack -1 has no ACK line, bytes are then
+ * spaced by a fixed gap instead of waiting for the pad's ACK pulse.
+ * DAT and ACK are open drain: they are requested with the chip's pull-ups,
+ * on a chip that can't bias its lines they need external ones (1k-10k to 3.3V).
+ */
+struct PSXPadGPIO_Lines {
+	uint32_t u32Dat;
+	uint32_t u32Cmd;
+	uint32_t u32Clk;
+	int32_t i32Ack;
+	uint32_t lu32Att[PSXPAD_MAXPADNUM];
+};
+
+/* the clock is shifted out by the CPU, 0 Hz is 125kHz as with spidev */
+struct PSXPads *PSXPads_InitGPIO(const char i_strChip[], const struct PSXPadGPIO_Lines *i_ptLines, const uint8_t i_u8PadNum, const uint32_t i_u32SpeedHz);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBPSXPAD_GPIO_H */
@@ -0,0 +1,328 @@
+/*
+ * PSX(Play Station 1/2) pad shared memory state (using libpsxpad)
+ *
+ * Copyright (c) 2017 AZO
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "libpsxpad_shm.h"
+
+#if PSXPADSHM_RING_NUM & (PSXPADSHM_RING_NUM - 1)
+#error PSXPADSHM_RING_NUM must be a power of 2
+#endif
+
+#define PSXPADSHM_MAGIC		0x50535850	/* "PSXP" */
+#define PSXPADSHM_CACHELINE	64
+
+/*
+ * both use the seqlock scheme: odd while the publisher writes, readers
+ * copy and retry if it was odd or changed meanwhile. a ring entry's
+ * sequence also tells which position it holds, 2 * pos + 2 once written.
+ */
+struct PSXPadShm_Slot {
+	uint32_t u32Seq;
+	uint64_t u64TimeNs;
+	struct PSXPad_PackedState tState;
+} __attribute__((aligned(PSXPADSHM_CACHELINE)));
+
+struct PSXPadShm_Entry {
+	uint64_t u64Seq;
+	struct PSXPadShm_Event tEvent;
+} __attribute__((aligned(PSXPADSHM_CACHELINE)));
+
+struct PSXPadShm_Segment {
+	uint32_t u32Magic;
+	uint32_t u32Size;
+	/* written by the publisher only */
+	uint64_t u64Head __attribute__((aligned(PSXPADSHM_CACHELINE)));
+	uint32_t u32Futex;	/* low bits of u64Head */
+	/* written by blocking readers only */
+	uint32_t u32Waiters __attribute__((aligned(PSXPADSHM_CACHELINE)));
+	struct PSXPadShm_Slot ltSlot[PSXPAD_MAXPADNUM][PSXPAD_TAP_PORTS];
+	struct PSXPadShm_Entry ltEntry[PSXPADSHM_RING_NUM];
+};
+
+struct PSXPadShm {
+	struct PSXPadShm_Segment *ptSeg;
+	char *strName;	/* set for the publisher, which unlinks on close */
+	uint8_t bReadOnly;	/* reader without write access, can't PSXPadShm_Wait() */
+};
+
+static struct PSXPadShm *PSXPadShm_Map(const char i_strName[], const int i_iFlags, const mode_t i_tMode)
+{
+	struct PSXPadShm *ptShm;
+	struct stat tStat;
+	int iFD, iErrno;
+	int iProt = PROT_READ | PROT_WRITE;
+
+	if (!i_strName) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	ptShm = calloc(1, sizeof(*ptShm));
+	if (!ptShm)
+		return NULL;
+
+	/* readers map it writable when they may, they register as futex waiters */
+	iFD = shm_open(i_strName, O_RDWR | O_CLOEXEC | i_iFlags, i_tMode);
+	if (iFD < 0 && errno == EACCES && !(i_iFlags & O_CREAT)) {
+		iFD = shm_open(i_strName, O_RDONLY | O_CLOEXEC, 0);
+		iProt = PROT_READ;
+		ptShm->bReadOnly = 1;
+	}
+	if (iFD < 0)
+		goto err_free;
+	/* exactly the mode asked for, not narrowed by the umask */
+	if ((i_iFlags & O_CREAT) && fchmod(iFD, i_tMode) < 0)
+		goto err_unlink;
+	if ((i_iFlags & O_CREAT) && ftruncate(iFD, sizeof(*ptShm->ptSeg)) < 0)
+		goto err_unlink;
+	if (fstat(iFD, &tStat) < 0)
+		goto err_unlink;
+	if (tStat.st_size != sizeof(*ptShm->ptSeg)) {
+		errno = EPROTO;
+		goto err_unlink;
+	}
+
+	ptShm->ptSeg = mmap(NULL, sizeof(*ptShm->ptSeg), iProt, MAP_SHARED, iFD, 0);
+	if (ptShm->ptSeg == MAP_FAILED)
+		goto err_unlink;
+	close(iFD);
+
+	return ptShm;
+
+err_unlink:
+	iErrno = errno;
+	if (i_iFlags & O_CREAT)
+		shm_unlink(i_strName);
+	close(iFD);
+	errno = iErrno;
+err_free:
+	free(ptShm);
+	return NULL;
+}
+
+struct PSXPadShm *PSXPadShm_Create(const char i_strName[], const mode_t i_tMode)
+{
+	struct PSXPadShm *ptShm;
+
+	/* a segment left over by a publisher that crashed is replaced */
+	if (i_strName)
+		shm_unlink(i_strName);
+
+	ptShm = PSXPadShm_Map(i_strName, O_CREAT | O_EXCL, i_tMode ? i_tMode : 0600);
+	if (!ptShm)
+		return NULL;
+
+	ptShm->strName = strdup(i_strName);
+	if (!ptShm->strName) {
+		PSXPadShm_Close(ptShm);
+		shm_unlink(i_strName);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	/* a fresh segment is zeroed; readers check the magic last */
+	ptShm->ptSeg->u32Size = sizeof(*ptShm->ptSeg);
+	__atomic_store_n(&ptShm->ptSeg->u32Magic, PSXPADSHM_MAGIC, __ATOMIC_RELEASE);
+
+	return ptShm;
+}
+
+struct PSXPadShm *PSXPadShm_Open(const char i_strName[])
+{
+	struct PSXPadShm *ptShm;
+
+	ptShm = PSXPadShm_Map(i_strName, 0, 0);
+	if (!ptShm)
+		return NULL;
+
+	if (__atomic_load_n(&ptShm->ptSeg->u32Magic, __ATOMIC_ACQUIRE) != PSXPADSHM_MAGIC || ptShm->ptSeg->u32Size != sizeof(*ptShm->ptSeg)) {
+		PSXPadShm_Close(ptShm);
+		errno = EPROTO;
+		return NULL;
+	}
+
+	return ptShm;
+}
+
+void PSXPadShm_Close(struct PSXPadShm *ptShm)
+{
+	if (!ptShm)
+		return;
+
+	munmap(ptShm->ptSeg, sizeof(*ptShm->ptSeg));
+	if (ptShm->strName) {
+		shm_unlink(ptShm->strName);
+		free(ptShm->strName);
+	}
+	free(ptShm);
+}
+
+int PSXPadShm_Publish(struct PSXPadShm *ptShm, const uint8_t u8PadNo, const uint8_t u8Port, const struct PSXPad_PackedState *i_ptState, const struct timespec *i_ptTime)
+{
+	struct PSXPadShm_Segment *ptSeg;
+	struct PSXPadShm_Slot *ptSlot;
+	struct PSXPadShm_Entry *ptEntry;
+	struct timespec tNow;
+	uint64_t u64TimeNs, u64Head;
+	uint32_t u32Seq;
+
+	if (!ptShm || !ptShm->strName || u8PadNo >= PSXPAD_MAXPADNUM || u8Port >= PSXPAD_TAP_PORTS || !i_ptState) {
+		errno = EINVAL;
+		return -1;
+	}
+	ptSeg = ptShm->ptSeg;
+
+	if (!i_ptTime) {
+		clock_gettime(CLOCK_MONOTONIC, &tNow);
+		i_ptTime = &tNow;
+	}
+	u64TimeNs = (uint64_t)i_ptTime->tv_sec * 1000000000 + i_ptTime->tv_nsec;
+
+	/* current state */
+	ptSlot = &ptSeg->ltSlot[u8PadNo][u8Port];
+	u32Seq = ptSlot->u32Seq;
+	__atomic_store_n(&ptSlot->u32Seq, u32Seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	ptSlot->u64TimeNs = u64TimeNs;
+	ptSlot->tState = *i_ptState;
+	__atomic_store_n(&ptSlot->u32Seq, u32Seq + 2, __ATOMIC_RELEASE);
+
+	/* ring, the oldest entry is overwritten */
+	u64Head = ptSeg->u64Head;
+	ptEntry = &ptSeg->ltEntry[u64Head & (PSXPADSHM_RING_NUM - 1)];
+	__atomic_store_n(&ptEntry->u64Seq, 2 * u64Head + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	ptEntry->tEvent.u64TimeNs = u64TimeNs;
+	ptEntry->tEvent.u8PadNo = u8PadNo;
+	ptEntry->tEvent.u8Port = u8Port;
+	ptEntry->tEvent.tState = *i_ptState;
+	__atomic_store_n(&ptEntry->u64Seq, 2 * u64Head + 2, __ATOMIC_RELEASE);
+	__atomic_store_n(&ptSeg->u64Head, u64Head + 1, __ATOMIC_RELEASE);
+
+	/* pairs with the waiter count taken before a reader checks the head */
+	__atomic_store_n(&ptSeg->u32Futex, (uint32_t)(u64Head + 1), __ATOMIC_RELEASE);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&ptSeg->u32Waiters, __ATOMIC_RELAXED))
+		syscall(SYS_futex, &ptSeg->u32Futex, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+
+	return 0;
+}
+
+int PSXPadShm_GetState(const struct PSXPadShm *ptShm, const uint8_t u8PadNo, const uint8_t u8Port, struct PSXPad_PackedState *o_ptState, uint64_t *o_pu64TimeNs)
+{
+	const struct PSXPadShm_Slot *ptSlot;
+	uint32_t u32Seq;
+
+	if (!ptShm || u8PadNo >= PSXPAD_MAXPADNUM || u8Port >= PSXPAD_TAP_PORTS || !o_ptState) {
+		errno = EINVAL;
+		return -1;
+	}
+	ptSlot = &ptShm->ptSeg->ltSlot[u8PadNo][u8Port];
+
+	do {
+		u32Seq = __atomic_load_n(&ptSlot->u32Seq, __ATOMIC_ACQUIRE);
+		*o_ptState = ptSlot->tState;
+		if (o_pu64TimeNs)
+			*o_pu64TimeNs = ptSlot->u64TimeNs;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while ((u32Seq & 1) || u32Seq != __atomic_load_n(&ptSlot->u32Seq, __ATOMIC_RELAXED));
+
+	if (u32Seq == 0)
+		o_ptState->u8Type = PSXPAD_KEYSTATE_TYPE_UNKNOWN;
+
+	return 0;
+}
+
+uint64_t PSXPadShm_Head(const struct PSXPadShm *ptShm)
+{
+	if (!ptShm)
+		return 0;
+
+	return __atomic_load_n(&ptShm->ptSeg->u64Head, __ATOMIC_ACQUIRE);
+}
+
+int PSXPadShm_Read(const struct PSXPadShm *ptShm, uint64_t *io_pu64Pos, struct PSXPadShm_Event *o_ptEvent)
+{
+	const struct PSXPadShm_Entry *ptEntry;
+	uint64_t u64Pos, u64Head, u64Seq;
+
+	if (!ptShm || !io_pu64Pos || !o_ptEvent) {
+		errno = EINVAL;
+		return -1;
+	}
+	u64Pos = *io_pu64Pos;
+
+	u64Head = PSXPadShm_Head(ptShm);
+	if (u64Pos >= u64Head)
+		return 0;
+	if (u64Head - u64Pos > PSXPADSHM_RING_NUM)
+		goto overrun;
+
+	ptEntry = &ptShm->ptSeg->ltEntry[u64Pos & (PSXPADSHM_RING_NUM - 1)];
+	u64Seq = __atomic_load_n(&ptEntry->u64Seq, __ATOMIC_ACQUIRE);
+	*o_ptEvent = ptEntry->tEvent;
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	/* the publisher lapped the reader while it copied */
+	if (u64Seq != 2 * u64Pos + 2 || u64Seq != __atomic_load_n(&ptEntry->u64Seq, __ATOMIC_RELAXED))
+		goto overrun;
+
+	*io_pu64Pos = u64Pos + 1;
+
+	return 1;
+
+overrun:
+	*io_pu64Pos = PSXPadShm_Head(ptShm);
+	errno = EOVERFLOW;
+	return -1;
+}
+
+int PSXPadShm_Wait(struct PSXPadShm *ptShm, const uint64_t u64Pos, const struct timespec *i_ptTimeout)
+{
+	struct PSXPadShm_Segment *ptSeg;
+	uint32_t u32Futex;
+	int ret = 0;
+
+	if (!ptShm) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (ptShm->bReadOnly) {
+		errno = EACCES;
+		return -1;
+	}
+	ptSeg = ptShm->ptSeg;
+
+	__atomic_fetch_add(&ptSeg->u32Waiters, 1, __ATOMIC_SEQ_CST);
+	while (1) {
+		u32Futex = __atomic_load_n(&ptSeg->u32Futex, __ATOMIC_ACQUIRE);
+		if (PSXPadShm_Head(ptShm) > u64Pos)
+			break;
+
+		/* the timeout restarts after a spurious wake-up, good enough for a reader */
+		if (syscall(SYS_futex, &ptSeg->u32Futex, FUTEX_WAIT, u32Futex, i_ptTimeout, NULL, 0) < 0 && errno != EAGAIN && errno != EINTR) {
+			ret = -1;
+			break;
+		}
+	}
+	__atomic_fetch_sub(&ptSeg->u32Waiters, 1, __ATOMIC_SEQ_CST);
+
+	return ret;
+}
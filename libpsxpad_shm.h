@@ -0,0 +1,75 @@
+/*
+ * PSX(Play Station 1/2) pad shared memory state (using libpsxpad)
+ *
+ * Copyright (c) 2017 AZO
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License.
+ */
+
+#ifndef LIBPSXPAD_SHM_H
+#define LIBPSXPAD_SHM_H
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include "libpsxpad.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* frames kept for readers that fall behind, a power of 2 */
+#define PSXPADSHM_RING_NUM	256
+
+struct PSXPadShm_Event {
+	uint64_t u64TimeNs;	/* CLOCK_MONOTONIC */
+	uint8_t u8PadNo;
+	uint8_t u8Port;
+	struct PSXPad_PackedState tState;
+};
+
+/*
+ * one process polls the pads and publishes into a POSIX shared memory
+ * segment, any number of processes read it without syscalls: the current
+ * state of each pad/port sits behind a seqlock, and every published frame
+ * also goes into a ring that readers follow at their own position.
+ * PSXPadShm_Wait() sleeps on a futex in the segment for blocking readers;
+ * the publisher only makes the wake-up syscall while someone waits.
+ */
+struct PSXPadShm;
+
+/*
+ * functions returning int give 0 on success, -1 with errno set on failure
+ * i_tMode is the segment's permission, 0 gives 0600 (only the publisher's
+ * user); readers need write access for PSXPadShm_Wait(), with read access
+ * alone (e.g. 0640) they can only poll and PSXPadShm_Wait() fails with EACCES
+ */
+struct PSXPadShm *PSXPadShm_Create(const char i_strName[], const mode_t i_tMode);
+struct PSXPadShm *PSXPadShm_Open(const char i_strName[]);
+void PSXPadShm_Close(struct PSXPadShm *ptShm);
+
+/* i_ptTime NULL stamps the frame with the current time */
+int PSXPadShm_Publish(struct PSXPadShm *ptShm, const uint8_t u8PadNo, const uint8_t u8Port, const struct PSXPad_PackedState *i_ptState, const struct timespec *i_ptTime);
+
+/* 0 and PSXPAD_KEYSTATE_TYPE_UNKNOWN until the pad has published once */
+int PSXPadShm_GetState(const struct PSXPadShm *ptShm, const uint8_t u8PadNo, const uint8_t u8Port, struct PSXPad_PackedState *o_ptState, uint64_t *o_pu64TimeNs);
+
+/*
+ * ring: PSXPadShm_Head() is the position the next frame goes to, start
+ * reading there; PSXPadShm_Read() returns 1 and advances io_pu64Pos when
+ * a frame was read, 0 when there is none yet, and -1 with EOVERFLOW when
+ * the reader was overrun, io_pu64Pos is then moved to the head
+ */
+uint64_t PSXPadShm_Head(const struct PSXPadShm *ptShm);
+int PSXPadShm_Read(const struct PSXPadShm *ptShm, uint64_t *io_pu64Pos, struct PSXPadShm_Event *o_ptEvent);
+/* blocks until a frame at u64Pos is there, ETIMEDOUT after i_ptTimeout (NULL waits forever) */
+int PSXPadShm_Wait(struct PSXPadShm *ptShm, const uint64_t u64Pos, const struct timespec *i_ptTimeout);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBPSXPAD_SHM_H */
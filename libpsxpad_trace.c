@@ -0,0 +1,389 @@
+/*
+ * PSX(Play Station 1/2) pad frame trace (record and replay)
+ *
+ * Copyright (c) 2017 AZO
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "libpsxpad.h"
+#include "libpsxpad_trace.h"
+
+#define PSXPADTRACE_VERSION	1
+#define PSXPADTRACE_HEADER_LEN	16
+
+enum {
+	PSXPADTRACE_CYCLE = 0x01,
+	PSXPADTRACE_REPEAT = 0x02,
+	PSXPADTRACE_RESYNC = 0x03
+};
+
+/* an idle pad would hold its run back forever, it is written once a second */
+#define PSXPADTRACE_FLUSH_NS	1000000000ULL
+
+/* varint, unsigned LEB128, and the largest cycle record */
+#define PSXPADTRACE_VARINT_MAX	10
+#define PSXPADTRACE_RECORD_MAX	(1 + PSXPADTRACE_VARINT_MAX + 1 + PSXPAD_MAXPADNUM * (1 + PSXPADTRACE_FRAME_MAX / 8 + PSXPADTRACE_FRAME_MAX))
+
+struct PSXPadTrace {
+	FILE *ptFile;
+	uint8_t bWriter;
+	uint8_t u8PadsNum;
+	/* last frame of each pad, both sides diff against it */
+	uint8_t llu8Frame[PSXPAD_MAXPADNUM][PSXPADTRACE_FRAME_MAX];
+	uint8_t lu8Len[PSXPAD_MAXPADNUM];
+	uint64_t u64StartNs;
+	uint64_t u64LastNs;	/* time of the last cycle written/read */
+	/* writer: unchanged cycles not written yet */
+	uint32_t u32Run;
+	uint64_t u64RunNs;	/* time of the last of them */
+	/* reader: repeat run being replayed, and the cycle Peek() decoded */
+	uint32_t u32RunLeft;
+	uint32_t u32RunCount;
+	uint64_t u64RunStartNs;
+	uint64_t u64RunLenNs;
+	uint8_t bStaged;
+};
+
+static uint8_t PSXPadTrace_PutVarint(uint8_t o_lu8Buf[], uint64_t i_u64Value)
+{
+	uint8_t u8Len = 0;
+
+	while (i_u64Value >= 0x80) {
+		o_lu8Buf[u8Len++] = (i_u64Value & 0x7F) | 0x80;
+		i_u64Value >>= 7;
+	}
+	o_lu8Buf[u8Len++] = i_u64Value;
+
+	return u8Len;
+}
+
+static int PSXPadTrace_GetVarint(FILE *ptFile, uint64_t *o_pu64Value)
+{
+	uint64_t u64Value = 0;
+	int iShift, c;
+
+	for (iShift = 0; iShift < 64; iShift += 7) {
+		c = getc_unlocked(ptFile);
+		if (c == EOF) {
+			errno = EPROTO;
+			return -1;
+		}
+		u64Value |= (uint64_t)(c & 0x7F) << iShift;
+		if (!(c & 0x80)) {
+			*o_pu64Value = u64Value;
+			return 0;
+		}
+	}
+
+	errno = EPROTO;
+	return -1;
+}
+
+struct PSXPadTrace *PSXPadTrace_Create(const char i_strPath[], const uint8_t i_u8PadsNum, const uint64_t i_u64StartNs)
+{
+	struct PSXPadTrace *ptTrace;
+	uint8_t lu8Header[PSXPADTRACE_HEADER_LEN] = {'P', 'S', 'X', 'T', PSXPADTRACE_VERSION};
+	int i;
+
+	if (!i_strPath || i_u8PadsNum == 0 || i_u8PadsNum > PSXPAD_MAXPADNUM) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	ptTrace = calloc(1, sizeof(*ptTrace));
+	if (!ptTrace)
+		return NULL;
+	ptTrace->ptFile = fopen(i_strPath, "wbe");
+	if (!ptTrace->ptFile) {
+		free(ptTrace);
+		return NULL;
+	}
+	ptTrace->bWriter = 1;
+	ptTrace->u8PadsNum = i_u8PadsNum;
+	ptTrace->u64StartNs = ptTrace->u64LastNs = i_u64StartNs;
+
+	lu8Header[5] = i_u8PadsNum;
+	for (i = 0; i < 8; i++)
+		lu8Header[8 + i] = i_u64StartNs >> (i * 8);
+	if (fwrite(lu8Header, sizeof(lu8Header), 1, ptTrace->ptFile) != 1) {
+		PSXPadTrace_Close(ptTrace);
+		return NULL;
+	}
+
+	return ptTrace;
+}
+
+static int PSXPadTrace_FlushRun(struct PSXPadTrace *ptTrace)
+{
+	uint8_t lu8Buf[1 + 2 * PSXPADTRACE_VARINT_MAX];
+	uint8_t u8Len = 0;
+
+	if (ptTrace->u32Run == 0)
+		return 0;
+
+	lu8Buf[u8Len++] = PSXPADTRACE_REPEAT;
+	u8Len += PSXPadTrace_PutVarint(&lu8Buf[u8Len], ptTrace->u32Run);
+	u8Len += PSXPadTrace_PutVarint(&lu8Buf[u8Len], ptTrace->u64RunNs - ptTrace->u64LastNs);
+	ptTrace->u64LastNs = ptTrace->u64RunNs;
+	ptTrace->u32Run = 0;
+
+	return (fwrite(lu8Buf, u8Len, 1, ptTrace->ptFile) == 1) ? 0 : -1;
+}
+
+int PSXPadTrace_Write(struct PSXPadTrace *ptTrace, const uint64_t i_u64TimeNs, const uint8_t *const i_lpu8Frame[], const uint8_t i_lu8Len[])
+{
+	uint8_t lu8Buf[PSXPADTRACE_RECORD_MAX];
+	uint8_t *pu8Mask;
+	uint8_t u8PadNo, u8Loc, u8Changed = 0;
+	uint16_t u16Len = 0;
+
+	if (!ptTrace || !ptTrace->bWriter || !i_lpu8Frame || !i_lu8Len) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	for (u8PadNo = 0; u8PadNo < ptTrace->u8PadsNum; u8PadNo++) {
+		if (i_lu8Len[u8PadNo] > PSXPADTRACE_FRAME_MAX) {
+			errno = EINVAL;
+			return -1;
+		}
+		if (i_lu8Len[u8PadNo] != ptTrace->lu8Len[u8PadNo] || memcmp(i_lpu8Frame[u8PadNo], ptTrace->llu8Frame[u8PadNo], i_lu8Len[u8PadNo]))
+			u8Changed |= 1 << u8PadNo;
+	}
+
+	/* unchanged cycles only count, up to once a second */
+	if (!u8Changed) {
+		ptTrace->u32Run++;
+		ptTrace->u64RunNs = i_u64TimeNs;
+		if (ptTrace->u32Run == UINT32_MAX || i_u64TimeNs - ptTrace->u64LastNs >= PSXPADTRACE_FLUSH_NS)
+			return PSXPadTrace_FlushRun(ptTrace);
+		return 0;
+	}
+	if (PSXPadTrace_FlushRun(ptTrace) < 0)
+		return -1;
+
+	lu8Buf[u16Len++] = PSXPADTRACE_CYCLE;
+	u16Len += PSXPadTrace_PutVarint(&lu8Buf[u16Len], i_u64TimeNs - ptTrace->u64LastNs);
+	lu8Buf[u16Len++] = u8Changed;
+	for (u8PadNo = 0; u8PadNo < ptTrace->u8PadsNum; u8PadNo++) {
+		if (!(u8Changed & (1 << u8PadNo)))
+			continue;
+
+		lu8Buf[u16Len++] = i_lu8Len[u8PadNo];
+		pu8Mask = &lu8Buf[u16Len];
+		memset(pu8Mask, 0, (i_lu8Len[u8PadNo] + 7) / 8);
+		u16Len += (i_lu8Len[u8PadNo] + 7) / 8;
+		for (u8Loc = 0; u8Loc < i_lu8Len[u8PadNo]; u8Loc++) {
+			if (i_lpu8Frame[u8PadNo][u8Loc] == ptTrace->llu8Frame[u8PadNo][u8Loc])
+				continue;
+			pu8Mask[u8Loc / 8] |= 1 << (u8Loc % 8);
+			lu8Buf[u16Len++] = i_lpu8Frame[u8PadNo][u8Loc];
+		}
+
+		memcpy(ptTrace->llu8Frame[u8PadNo], i_lpu8Frame[u8PadNo], i_lu8Len[u8PadNo]);
+		ptTrace->lu8Len[u8PadNo] = i_lu8Len[u8PadNo];
+	}
+	ptTrace->u64LastNs = i_u64TimeNs;
+
+	return (fwrite(lu8Buf, u16Len, 1, ptTrace->ptFile) == 1) ? 0 : -1;
+}
+
+struct PSXPadTrace *PSXPadTrace_Open(const char i_strPath[])
+{
+	struct PSXPadTrace *ptTrace;
+	uint8_t lu8Header[PSXPADTRACE_HEADER_LEN];
+	int i;
+
+	if (!i_strPath) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	ptTrace = calloc(1, sizeof(*ptTrace));
+	if (!ptTrace)
+		return NULL;
+	ptTrace->ptFile = fopen(i_strPath, "rbe");
+	if (!ptTrace->ptFile) {
+		free(ptTrace);
+		return NULL;
+	}
+
+	if (fread(lu8Header, sizeof(lu8Header), 1, ptTrace->ptFile) != 1 || memcmp(lu8Header, "PSXT", 4) || lu8Header[4] != PSXPADTRACE_VERSION || lu8Header[5] == 0 || lu8Header[5] > PSXPAD_MAXPADNUM) {
+		PSXPadTrace_Close(ptTrace);
+		errno = EPROTO;
+		return NULL;
+	}
+	ptTrace->u8PadsNum = lu8Header[5];
+	for (i = 0; i < 8; i++)
+		ptTrace->u64StartNs |= (uint64_t)lu8Header[8 + i] << (i * 8);
+	ptTrace->u64LastNs = ptTrace->u64StartNs;
+
+	return ptTrace;
+}
+
+uint8_t PSXPadTrace_PadsNum(const struct PSXPadTrace *ptTrace)
+{
+	return ptTrace ? ptTrace->u8PadsNum : 0;
+}
+
+/* the cycle record after its tag */
+static int PSXPadTrace_ReadCycle(struct PSXPadTrace *ptTrace)
+{
+	uint8_t lu8Mask[PSXPADTRACE_FRAME_MAX / 8];
+	uint8_t u8PadNo, u8Loc, u8Changed;
+	uint64_t u64Value;
+	int c;
+
+	if (PSXPadTrace_GetVarint(ptTrace->ptFile, &u64Value) < 0)
+		return -1;
+	ptTrace->u64LastNs += u64Value;
+
+	c = getc_unlocked(ptTrace->ptFile);
+	if (c == EOF)
+		goto err;
+	u8Changed = c;
+	for (u8PadNo = 0; u8PadNo < ptTrace->u8PadsNum; u8PadNo++) {
+		if (!(u8Changed & (1 << u8PadNo)))
+			continue;
+
+		c = getc_unlocked(ptTrace->ptFile);
+		if (c == EOF || c > PSXPADTRACE_FRAME_MAX)
+			goto err;
+		ptTrace->lu8Len[u8PadNo] = c;
+		if (fread(lu8Mask, 1, (c + 7) / 8, ptTrace->ptFile) != (c + 7) / 8)
+			goto err;
+		for (u8Loc = 0; u8Loc < ptTrace->lu8Len[u8PadNo]; u8Loc++) {
+			if (!(lu8Mask[u8Loc / 8] & (1 << (u8Loc % 8))))
+				continue;
+			c = getc_unlocked(ptTrace->ptFile);
+			if (c == EOF)
+				goto err;
+			ptTrace->llu8Frame[u8PadNo][u8Loc] = c;
+		}
+	}
+
+	return 1;
+
+err:
+	errno = EPROTO;
+	return -1;
+}
+
+/* decodes the next cycle into the last frames, 0 at the end */
+static int PSXPadTrace_Stage(struct PSXPadTrace *ptTrace)
+{
+	uint64_t u64Count, u64Value;
+	int c;
+
+	if (ptTrace->bStaged)
+		return 1;
+
+	/* cycle k of a run of n is at start + len * k / n */
+	if (ptTrace->u32RunLeft) {
+		ptTrace->u32RunLeft--;
+		ptTrace->u64LastNs = ptTrace->u64RunStartNs + ptTrace->u64RunLenNs * (ptTrace->u32RunCount - ptTrace->u32RunLeft) / ptTrace->u32RunCount;
+		ptTrace->bStaged = 1;
+		return 1;
+	}
+
+	while (1) {
+		c = getc_unlocked(ptTrace->ptFile);
+		if (c == EOF)
+			return ferror(ptTrace->ptFile) ? -1 : 0;
+
+		switch (c) {
+		case PSXPADTRACE_CYCLE:
+			if (PSXPadTrace_ReadCycle(ptTrace) < 0)
+				return -1;
+			ptTrace->bStaged = 1;
+			return 1;
+		case PSXPADTRACE_REPEAT:
+			if (PSXPadTrace_GetVarint(ptTrace->ptFile, &u64Count) < 0 || PSXPadTrace_GetVarint(ptTrace->ptFile, &u64Value) < 0)
+				return -1;
+			if (u64Count == 0 || u64Count > UINT32_MAX) {
+				errno = EPROTO;
+				return -1;
+			}
+			ptTrace->u32RunCount = ptTrace->u32RunLeft = u64Count;
+			ptTrace->u64RunStartNs = ptTrace->u64LastNs;
+			ptTrace->u64RunLenNs = u64Value;
+			return PSXPadTrace_Stage(ptTrace);
+		case PSXPADTRACE_RESYNC:
+			if (PSXPadTrace_GetVarint(ptTrace->ptFile, &u64Value) < 0)
+				return -1;
+			ptTrace->u64LastNs = ptTrace->u64StartNs + u64Value;
+			memset(ptTrace->llu8Frame, 0, sizeof(ptTrace->llu8Frame));
+			memset(ptTrace->lu8Len, 0, sizeof(ptTrace->lu8Len));
+			break;
+		default:
+			errno = EPROTO;
+			return -1;
+		}
+	}
+}
+
+int PSXPadTrace_Read(struct PSXPadTrace *ptTrace, uint64_t *o_pu64TimeNs, uint8_t o_llu8Frame[][PSXPADTRACE_FRAME_MAX], uint8_t o_lu8Len[])
+{
+	uint8_t u8PadNo;
+	int ret;
+
+	if (!ptTrace || ptTrace->bWriter || !o_llu8Frame || !o_lu8Len) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	ret = PSXPadTrace_Stage(ptTrace);
+	if (ret <= 0)
+		return ret;
+	ptTrace->bStaged = 0;
+
+	if (o_pu64TimeNs)
+		*o_pu64TimeNs = ptTrace->u64LastNs;
+	for (u8PadNo = 0; u8PadNo < ptTrace->u8PadsNum; u8PadNo++) {
+		memcpy(o_llu8Frame[u8PadNo], ptTrace->llu8Frame[u8PadNo], ptTrace->lu8Len[u8PadNo]);
+		o_lu8Len[u8PadNo] = ptTrace->lu8Len[u8PadNo];
+	}
+
+	return 1;
+}
+
+int PSXPadTrace_Peek(struct PSXPadTrace *ptTrace, uint64_t *o_pu64TimeNs)
+{
+	int ret;
+
+	if (!ptTrace || ptTrace->bWriter || !o_pu64TimeNs) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	ret = PSXPadTrace_Stage(ptTrace);
+	if (ret > 0)
+		*o_pu64TimeNs = ptTrace->u64LastNs;
+
+	return ret;
+}
+
+int PSXPadTrace_Close(struct PSXPadTrace *ptTrace)
+{
+	int ret = 0;
+
+	if (!ptTrace)
+		return 0;
+
+	if (ptTrace->bWriter && PSXPadTrace_FlushRun(ptTrace) < 0)
+		ret = -1;
+	if (fclose(ptTrace->ptFile) != 0)
+		ret = -1;
+	free(ptTrace);
+
+	return ret;
+}
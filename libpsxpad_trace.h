@@ -0,0 +1,61 @@
+/*
+ * PSX(Play Station 1/2) pad frame trace (record and replay)
+ *
+ * Copyright (c) 2017 AZO
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License.
+ */
+
+#ifndef LIBPSXPAD_TRACE_H
+#define LIBPSXPAD_TRACE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * a trace is the raw poll responses of every poll cycle, append-only:
+ *
+ *   header  "PSXT", u8 version (1), u8 pads, u16 0, u64 start ns (LE)
+ *   0x01    cycle: varint ns since the last cycle, u8 mask of the pads
+ *           whose frame changed, then per pad: u8 length, a bitmask of
+ *           (length + 7) / 8 bytes of the frame bytes that changed and
+ *           those bytes; a pad's first frame is diffed against zeros
+ *   0x02    repeat: varint count, varint ns the run took; count cycles
+ *           identical to the last one, evenly spaced over that time
+ *   0x03    resync: varint ns since the start, all frames are zeros again
+ *           (written by psxpad-spi after its buffer overflowed)
+ *
+ * varints are unsigned LEB128. psxpad-spi writes the same format to
+ * debugfs, psxpad-spi/<device>/trace, with one pad.
+ */
+#define PSXPADTRACE_FRAME_MAX	64
+
+struct PSXPadTrace;
+
+/* functions returning int give 0 on success, -1 with errno set on failure */
+struct PSXPadTrace *PSXPadTrace_Create(const char i_strPath[], const uint8_t i_u8PadsNum, const uint64_t i_u64StartNs);
+int PSXPadTrace_Write(struct PSXPadTrace *ptTrace, const uint64_t i_u64TimeNs, const uint8_t *const i_lpu8Frame[], const uint8_t i_lu8Len[]);
+
+/*
+ * PSXPadTrace_Read() returns 1 and the frames of one cycle, 0 at the end
+ * of the trace; PSXPadTrace_Peek() only gives the time of the cycle
+ * Read() returns next
+ */
+struct PSXPadTrace *PSXPadTrace_Open(const char i_strPath[]);
+uint8_t PSXPadTrace_PadsNum(const struct PSXPadTrace *ptTrace);
+int PSXPadTrace_Read(struct PSXPadTrace *ptTrace, uint64_t *o_pu64TimeNs, uint8_t o_llu8Frame[][PSXPADTRACE_FRAME_MAX], uint8_t o_lu8Len[]);
+int PSXPadTrace_Peek(struct PSXPadTrace *ptTrace, uint64_t *o_pu64TimeNs);
+
+/* a writer writes its pending repeat run first */
+int PSXPadTrace_Close(struct PSXPadTrace *ptTrace);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBPSXPAD_TRACE_H */
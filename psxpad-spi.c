@@ -16,69 +16,312 @@
  * 6: Attention -> CS(SS)
  * 7: SCK -> SCK
  * 8: N.C.
- * 9: ACK -> N.C.
+ * 9: ACK -> GPIO (optional "ack-gpios", allows faster SPI clocks)
  */
 
 #include <linux/kernel.h>
+#include <linux/bitrev.h>
+#include <linux/debugfs.h>
 #include <linux/device.h>
+#include <linux/fixp-arith.h>
+#include <linux/gpio/consumer.h>
 #include <linux/input.h>
-#include <linux/input-polldev.h>
+#include <linux/hrtimer.h>
+#include <linux/interrupt.h>
+#include <linux/kfifo.h>
+#include <linux/list.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/percpu.h>
+#include <linux/poll.h>
+#include <linux/property.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/version.h>
+#include <linux/wait_bit.h>
+#include <linux/workqueue.h>
 #include <linux/spi/spi.h>
 #include <linux/types.h>
 #include <linux/pm.h>
 #include <linux/pm_runtime.h>
 
-#define REVERSE_BIT(x) ((((x) & 0x80) >> 7) | (((x) & 0x40) >> 5) | \
-	(((x) & 0x20) >> 3) | (((x) & 0x10) >> 1) | (((x) & 0x08) << 1) | \
-	(((x) & 0x04) << 3) | (((x) & 0x02) << 5) | (((x) & 0x01) << 7))
+/* poll interval of the workqueue engine is about 60fps */
+#define PSXPAD_POLL_INTERVAL_MS		16
+/* range of the hrtimer engine, 0 selects the workqueue engine */
+#define PSXPAD_POLL_INTERVAL_US_MIN	1000
+#define PSXPAD_POLL_INTERVAL_US_MAX	32000
 
-/* PlayStation 1/2 joypad command and response are LSBFIRST. */
+/*
+ * Idle back-off: after the idle timeout without a state change polling
+ * slows down in two steps, and to the hot-plug rate while no pad answers.
+ * The first changed frame brings back the configured interval.
+ */
+#define PSXPAD_IDLE_TIMEOUT_MS		3000
+#define PSXPAD_IDLE_INTERVAL_US		50000
+#define PSXPAD_IDLE_INTERVAL2_US	100000
+#define PSXPAD_HOTPLUG_INTERVAL_US	250000
+
+/*
+ * SPI clock steps. Without an ACK line the pad is run at the safe 125kHz,
+ * with one the clock steps up after a run of fully acknowledged frames.
+ */
+static const u32 psxpad_speeds[] = { 125000, 250000, 500000, 1000000 };
+#define PSXPAD_SPEED_LAST		(ARRAY_SIZE(psxpad_speeds) - 1)
+#define PSXPAD_SPEED_STEP_FRAMES	256
 
 /*
- *	0x01, 0x42, 0x00, 0x00, 0x00,
- *	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
- *	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+ * PlayStation 1/2 joypad command and response are LSBFIRST. Commands are
+ * kept in protocol bit order, if the SPI controller can't shift LSB first
+ * the bytes are swapped with bitrev8() on the way (see psxpad_bitrev()).
  */
+
 static const u8 PSX_CMD_POLL[] = {
-	0x80, 0x42, 0x00, 0x00, 0x00,
+	0x01, 0x42, 0x00, 0x00, 0x00,
 	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
 	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
 };
-/*	0x01, 0x43, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00 */
+/*
+ * With the TAP byte set a multitap (SCPH-1070) answers with ID 0x80 and
+ * all four ports in 8 byte slots (ID, 0x5A, 6 data bytes).
+ */
+static const u8 PSX_CMD_TAP_POLL[] = {
+	0x01, 0x42, 0x01, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
 static const u8 PSX_CMD_ENTER_CFG[] = {
-	0x80, 0xC2, 0x00, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00
+	0x01, 0x43, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00
 };
-/*	0x01, 0x43, 0x00, 0x00, 0x5A, 0x5A, 0x5A, 0x5A, 0x5A */
 static const u8 PSX_CMD_EXIT_CFG[] = {
-	0x80, 0xC2, 0x00, 0x00, 0x5A, 0x5A, 0x5A, 0x5A, 0x5A
+	0x01, 0x43, 0x00, 0x00, 0x5A, 0x5A, 0x5A, 0x5A, 0x5A
 };
-/*	0x01, 0x4D, 0x00, 0x00, 0x01, 0xFF, 0xFF, 0xFF, 0xFF */
 static const u8 PSX_CMD_ENABLE_MOTOR[]	= {
-	0x80, 0xB2, 0x00, 0x00, 0x80, 0xFF, 0xFF, 0xFF, 0xFF
+	0x01, 0x4D, 0x00, 0x00, 0x01, 0xFF, 0xFF, 0xFF, 0xFF
+};
+static const u8 PSX_CMD_AD_MODE[] = {
+	0x01, 0x44, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+/* bytes 3-5 select which response bytes follow, 18 bits for all of them */
+static const u8 PSX_CMD_ALL_PRESSURE[] = {
+	0x01, 0x4F, 0x00, 0xFF, 0xFF, 0x03, 0x00, 0x00, 0x00
+};
+
+/* longest frame is a multitap, 3 header bytes and 16 data words */
+#define PSXPAD_FRAME_MAX	sizeof(PSX_CMD_TAP_POLL)
+#define PSXPAD_TAP_PORTS	4
+#define PSXPAD_TAP_SLOT_LEN	8
+
+/* poll transaction, two alternate so one decodes while the next is sent */
+struct psxpad_frame {
+	struct psxpad *pad;
+	struct spi_message msg;
+	struct spi_transfer xfer;
+	ktime_t submitted;
+	unsigned int motor_gen;	/* motor bytes in sendbuf are from this one */
+	u8 sendbuf[PSXPAD_FRAME_MAX] ____cacheline_aligned;
+	u8 response[PSXPAD_FRAME_MAX] ____cacheline_aligned;
+};
+
+/*
+ * Latency histograms in debugfs, per CPU so the poll path takes no lock.
+ * Bucket n counts samples of [2^(n-1), 2^n) us, bucket 0 those under 1us.
+ */
+enum {
+	PSXPAD_LAT_WAKE,	/* hrtimer tick fired vs. scheduled */
+	PSXPAD_LAT_XFER,	/* frame submitted to completion */
+	PSXPAD_LAT_DECODE,	/* completion to frame decoded */
+	PSXPAD_LAT_SYNC,	/* completion to input_sync() done */
+	PSXPAD_LAT_SAMPLE,	/* event timestamp to input_sync() done */
+	PSXPAD_LAT_NUM
+};
+
+#define PSXPAD_HIST_BUCKETS	20
+
+struct psxpad_hist {
+	u32 count[PSXPAD_LAT_NUM][PSXPAD_HIST_BUCKETS];
+};
+
+static const char * const psxpad_lat_names[PSXPAD_LAT_NUM] = {
+	[PSXPAD_LAT_WAKE]	= "wake",
+	[PSXPAD_LAT_XFER]	= "xfer",
+	[PSXPAD_LAT_DECODE]	= "decode",
+	[PSXPAD_LAT_SYNC]	= "sync",
+	[PSXPAD_LAT_SAMPLE]	= "sample",
+};
+
+static struct dentry *psxpad_debugfs_root;
+
+/*
+ * Raw poll responses streamed to debugfs "trace", in the format of
+ * libpsxpad_trace.h with one pad: a cycle record for each frame that
+ * changed, a repeat record counting the unchanged ones in between. When
+ * the reader falls behind, records are dropped and a resync record makes
+ * it start over from an empty frame.
+ */
+#define PSXPAD_TRACE_FIFO	16384
+#define PSXPAD_TRACE_HEADER_LEN	16
+/* repeat 21, resync 11 and cycle 53 bytes at most */
+#define PSXPAD_TRACE_RECORD_MAX	96
+
+enum {
+	PSXPAD_TRACE_CYCLE = 0x01,
+	PSXPAD_TRACE_REPEAT = 0x02,
+	PSXPAD_TRACE_RESYNC = 0x03,
+};
+
+struct psxpad_trace {
+	spinlock_t lock;	/* poll completions may overlap */
+	bool on;
+	bool resync;
+	DECLARE_KFIFO_PTR(fifo, u8);
+	struct mutex read_lock;
+	wait_queue_head_t wait;
+	u64 start;
+	u64 last;	/* time of the last record */
+	u32 run;	/* unchanged frames since then */
+	u64 run_ns;	/* time of the last of them */
+	u8 len;
+	u8 frame[PSXPAD_FRAME_MAX];
+};
+
+/*
+ * Pads on one SPI controller are polled from a single shared timer, or
+ * from the controller's own workqueue. The workqueue is high priority and
+ * unbound, so pads on different controllers poll in parallel on any CPU.
+ */
+struct psxpad_bus {
+	struct list_head node;
+	struct spi_controller *ctlr;
+	unsigned int refcount;
+	struct mutex lock;	/* serialises attach/detach against the timer */
+	spinlock_t pads_lock;
+	struct list_head pads;	/* open pads using the hrtimer engine */
+	struct hrtimer timer;
+	struct workqueue_struct *wq;
+};
+
+static LIST_HEAD(psxpad_buses);
+static DEFINE_MUTEX(psxpad_buses_lock);
+
+/* pad->flags */
+#define PSXPAD_POLL_BUSY	0
+#define PSXPAD_SUSPENDED	1	/* system sleep, no polls go out */
+#define PSXPAD_PM_IDLE		2	/* runtime PM reference dropped */
+#define PSXPAD_TRACING		3	/* debugfs trace is open */
+
+/* keeps the SPI controller up between closely spaced opens */
+#define PSXPAD_AUTOSUSPEND_MS	2000
+
+/* uploaded effect, playing while count has repeats left */
+struct psxpad_effect {
+	struct ff_effect effect;
+	ktime_t start;
+	ktime_t stop;	/* 0 plays until stopped */
+	int count;
+};
+
+#define PSXPAD_FF_EFFECTS	16
+
+/* last reported state of a port, each new frame is diffed against it */
+struct psxpad_state {
+	u16 buttons;	/* bit n set: bit n of data bytes 3-4 is pressed */
+	u8 axes[4];
+	u8 pressure[12];
 };
 
 struct psxpad {
 	struct spi_device *spi;
-	struct input_polled_dev *pdev;
+	struct input_dev *idev;
 	char phys[0x20];
+	bool lsb_first;
+	/* the pad pulses ACK after every byte but the last one */
+	struct gpio_desc *ack_gpio;
+	atomic_t acks;
+	ktime_t ack_stamp;	/* first ACK of the frame */
+	bool present;
+	unsigned int speed;	/* index into psxpad_speeds */
+	unsigned int speed_max;
+	unsigned int speed_good;
+	struct psxpad_hist __percpu *hist;
+	struct dentry *debugfs;
+	struct psxpad_trace trace;
+	/* written by the poll completion only, read through sysfs */
+	struct {
+		unsigned long good_frames;
+		unsigned long bad_frames;
+		unsigned long retries;
+		unsigned long disconnects;
+	} stats;
+	/* port A is idev, B-D are registered once a multitap shows up */
+	bool multitap;
+	struct input_dev *tap_input[PSXPAD_TAP_PORTS];
+	struct psxpad_state state[PSXPAD_TAP_PORTS];
+	char tap_phys[PSXPAD_TAP_PORTS][0x20];
 	bool motor1enable;
 	bool motor2enable;
 	u8 motor1level;
 	u8 motor2level;
-	u8 sendbuf[0x20] ____cacheline_aligned;
-	u8 response[sizeof(PSX_CMD_POLL)] ____cacheline_aligned;
+	unsigned int motor_gen;	/* bumped when the motor bytes change */
+#ifdef CONFIG_JOYSTICK_PSXPAD_SPI_FF
+	spinlock_t ff_lock;	/* effects, against the poll tick */
+	struct psxpad_effect effects[PSXPAD_FF_EFFECTS];
+	unsigned int ff_playing;
+	u32 weak_acc;
+#endif
+	/* config is only re-sent when it changes or the pad has lost it */
+	bool configured;
+	bool pressure;	/* DualShock 2 pressure bytes, 12 more per poll */
+	u8 mode;
+	u8 polllen;
+	u32 poll_interval_us;
+	struct delayed_work poll_work;	/* workqueue engine */
+	u32 idle_timeout_ms;
+	ktime_t last_change;
+	struct psxpad_bus *bus;
+	struct list_head bus_node;
+	ktime_t next_poll;
+	unsigned long flags;
+	struct work_struct config_work;
+	spinlock_t report_lock;
+	unsigned int frame;
+	struct psxpad_frame frames[2];
+	u8 sendbuf[PSXPAD_FRAME_MAX] ____cacheline_aligned;
+	u8 response[PSXPAD_FRAME_MAX] ____cacheline_aligned;
 };
 
+/* swap bit order of a buffer, unless the controller shifts LSB first */
+static void psxpad_bitrev(struct psxpad *pad, u8 *buf, unsigned int len)
+{
+	unsigned int i;
+
+	if (pad->lsb_first)
+		return;
+
+	for (i = 0; i < len; i++)
+		buf[i] = bitrev8(buf[i]);
+}
+
+static inline u8 psxpad_wire(struct psxpad *pad, u8 val)
+{
+	return pad->lsb_first ? val : bitrev8(val);
+}
+
 static int psxpad_command(struct psxpad *pad, const u8 sendcmdlen)
 {
 	struct spi_transfer xfers = {
 		.tx_buf		= pad->sendbuf,
 		.rx_buf		= pad->response,
 		.len		= sendcmdlen,
+		/* config mode is slow on some pads, keep to the safe clock */
+		.speed_hz	= psxpad_speeds[0],
 	};
 	int err;
 
+	psxpad_bitrev(pad, pad->sendbuf, sendcmdlen);
+
 	err = spi_sync_transfer(pad->spi, &xfers, 1);
 	if (err) {
 		dev_err(&pad->spi->dev,
@@ -87,6 +330,8 @@ static int psxpad_command(struct psxpad *pad, const u8 sendcmdlen)
 		return err;
 	}
 
+	psxpad_bitrev(pad, pad->response, sendcmdlen);
+
 	return 0;
 }
 
@@ -94,80 +339,252 @@ static int psxpad_command(struct psxpad *pad, const u8 sendcmdlen)
 static void psxpad_control_motor(struct psxpad *pad,
 				 bool motor1enable, bool motor2enable)
 {
-	int err;
+	if (pad->motor1enable == motor1enable &&
+	    pad->motor2enable == motor2enable)
+		return;
 
 	pad->motor1enable = motor1enable;
 	pad->motor2enable = motor2enable;
+	pad->motor_gen++;
+	pad->configured = false;
+}
 
-	memcpy(pad->sendbuf, PSX_CMD_ENTER_CFG, sizeof(PSX_CMD_ENTER_CFG));
-	err = psxpad_command(pad, sizeof(PSX_CMD_ENTER_CFG));
-	if (err) {
-		dev_err(&pad->spi->dev,
-			"%s: failed to enter config mode: %d\n",
-			__func__, err);
-		return;
-	}
+static int psxpad_configure_motor(struct psxpad *pad)
+{
+	int err;
 
 	memcpy(pad->sendbuf, PSX_CMD_ENABLE_MOTOR,
 	       sizeof(PSX_CMD_ENABLE_MOTOR));
 	pad->sendbuf[3] = pad->motor1enable ? 0x00 : 0xFF;
-	pad->sendbuf[4] = pad->motor2enable ? 0x80 : 0xFF;
+	pad->sendbuf[4] = pad->motor2enable ? 0x01 : 0xFF;
 	err = psxpad_command(pad, sizeof(PSX_CMD_ENABLE_MOTOR));
-	if (err) {
+	if (err)
 		dev_err(&pad->spi->dev,
 			"%s: failed to enable motor mode: %d\n",
 			__func__, err);
-		return;
-	}
 
-	memcpy(pad->sendbuf, PSX_CMD_EXIT_CFG, sizeof(PSX_CMD_EXIT_CFG));
-	err = psxpad_command(pad, sizeof(PSX_CMD_EXIT_CFG));
-	if (err) {
-		dev_err(&pad->spi->dev,
-			"%s: failed to exit config mode: %d\n",
-			__func__, err);
-		return;
-	}
+	return err;
 }
 
+/* motor bytes go out with the next poll frames, rewritten on change only */
 static void psxpad_set_motor_level(struct psxpad *pad,
 				   u8 motor1level, u8 motor2level)
 {
-	pad->motor1level = motor1level ? 0xFF : 0x00;
-	pad->motor2level = REVERSE_BIT(motor2level);
+	motor1level = motor1level ? 0xFF : 0x00;
+	if (pad->motor1level == motor1level &&
+	    pad->motor2level == motor2level)
+		return;
+
+	pad->motor1level = motor1level;
+	pad->motor2level = motor2level;
+	pad->motor_gen++;
+}
+
+static void psxpad_ff_start(struct psxpad_effect *e, ktime_t from)
+{
+	e->start = ktime_add_ms(from, e->effect.replay.delay);
+	e->stop = e->effect.replay.length ?
+		  ktime_add_ms(e->start, e->effect.replay.length) : 0;
+}
+
+/* attack and fade ramp from and to their own levels, 0-0x7fff */
+static int psxpad_ff_envelope(const struct psxpad_effect *e,
+			      const struct ff_envelope *env,
+			      int level, ktime_t now)
+{
+	s64 t;
+
+	t = ktime_ms_delta(now, e->start);
+	if (t < env->attack_length)
+		return env->attack_level +
+		       div_s64((s64)(level - env->attack_level) * t,
+			       env->attack_length);
+
+	if (e->stop) {
+		t = ktime_ms_delta(e->stop, now);
+		if (t < env->fade_length)
+			return env->fade_level +
+			       div_s64((s64)(level - env->fade_level) * t,
+				       env->fade_length);
+	}
+
+	return level;
 }
 
-static int psxpad_spi_play_effect(struct input_dev *idev,
-				  void *data, struct ff_effect *effect)
+/* motors only spin one way, waveforms swing between offset and magnitude */
+static int psxpad_ff_periodic(const struct psxpad_effect *e, ktime_t now)
 {
-	struct input_polled_dev *pdev = input_get_drvdata(idev);
-	struct psxpad *pad = pdev->private;
+	const struct ff_periodic_effect *periodic = &e->effect.u.periodic;
+	unsigned int period = max_t(u16, periodic->period, 1);
+	u32 t;
+	int phase, wave, level;
+
+	div_u64_rem(ktime_ms_delta(now, e->start), period, &t);
+	phase = t * 0x10000 / period;
 
-	switch (effect->type) {
-	case FF_RUMBLE:
-		psxpad_set_motor_level(pad,
-			(effect->u.rumble.weak_magnitude >> 8) & 0xFFU,
-			(effect->u.rumble.strong_magnitude >> 8) & 0xFFU);
+	switch (periodic->waveform) {
+	case FF_SQUARE:
+		wave = phase < 0x8000 ? 0x7FFF : -0x7FFF;
+		break;
+	case FF_TRIANGLE:
+		wave = phase < 0x8000 ? phase * 2 - 0x7FFF :
+					0x7FFF - (phase - 0x8000) * 2;
+		break;
+	case FF_SINE:
+		wave = fixp_sin16(t * 360 / period);
 		break;
+	case FF_SAW_UP:
+		wave = phase - 0x8000;
+		break;
+	case FF_SAW_DOWN:
+		wave = 0x7FFF - phase;
+		break;
+	default:
+		wave = 0x7FFF;
+		break;
+	}
+
+	level = psxpad_ff_envelope(e, &periodic->envelope,
+				   abs(periodic->magnitude), now);
+	level = periodic->offset + level * (wave + 0x8000) / 0x10000;
+
+	return clamp(level, 0, 0x7FFF);
+}
+
+/*
+ * Called for every poll frame instead of running the memless timer, so
+ * effects change the motors in step with the poll clock and never cost
+ * an extra SPI transfer. Constant and periodic effects drive both motors.
+ */
+static void psxpad_ff_update(struct psxpad *pad, ktime_t now)
+{
+	struct psxpad_effect *e;
+	unsigned long flags;
+	u32 strong = 0, weak = 0;
+	int i, level;
+
+	spin_lock_irqsave(&pad->ff_lock, flags);
+
+	for (i = 0; i < ARRAY_SIZE(pad->effects); i++) {
+		e = &pad->effects[i];
+		if (!e->count)
+			continue;
+
+		if (e->stop && !ktime_before(now, e->stop)) {
+			if (--e->count) {
+				psxpad_ff_start(e, e->stop);
+			} else {
+				pad->ff_playing--;
+				continue;
+			}
+		}
+
+		if (ktime_before(now, e->start))
+			continue;
+
+		switch (e->effect.type) {
+		case FF_RUMBLE:
+			strong += e->effect.u.rumble.strong_magnitude;
+			weak += e->effect.u.rumble.weak_magnitude;
+			break;
+		case FF_CONSTANT:
+			level = psxpad_ff_envelope(e,
+					&e->effect.u.constant.envelope,
+					abs(e->effect.u.constant.level), now);
+			strong += level * 2;
+			weak += level * 2;
+			break;
+		case FF_PERIODIC:
+			level = psxpad_ff_periodic(e, now);
+			strong += level * 2;
+			weak += level * 2;
+			break;
+		}
+	}
+
+	spin_unlock_irqrestore(&pad->ff_lock, flags);
+
+	/* the small motor is on/off only, its level is spread over frames */
+	weak = min_t(u32, weak, 0xFFFF);
+	pad->weak_acc = weak ? pad->weak_acc + weak : 0;
+	if (pad->weak_acc >= 0xFFFF)
+		pad->weak_acc -= 0xFFFF;
+	else
+		weak = 0;
+
+	psxpad_set_motor_level(pad, weak ? 0xFF : 0x00,
+			       min_t(u32, strong, 0xFFFF) >> 8);
+}
+
+static bool psxpad_ff_active(struct psxpad *pad)
+{
+	return READ_ONCE(pad->ff_playing);
+}
+
+static int psxpad_ff_upload(struct input_dev *idev, struct ff_effect *effect,
+			    struct ff_effect *old)
+{
+	struct psxpad *pad = input_get_drvdata(idev);
+	unsigned long flags;
+
+	/* a playing effect carries on with the new parameters */
+	spin_lock_irqsave(&pad->ff_lock, flags);
+	pad->effects[effect->id].effect = *effect;
+	spin_unlock_irqrestore(&pad->ff_lock, flags);
+
+	return 0;
+}
+
+static int psxpad_ff_playback(struct input_dev *idev, int effect_id, int value)
+{
+	struct psxpad *pad = input_get_drvdata(idev);
+	struct psxpad_effect *e = &pad->effects[effect_id];
+	unsigned long flags;
+
+	spin_lock_irqsave(&pad->ff_lock, flags);
+
+	if (value > 0) {
+		if (!e->count)
+			pad->ff_playing++;
+		e->count = value;
+		psxpad_ff_start(e, ktime_get());
+	} else if (e->count) {
+		e->count = 0;
+		pad->ff_playing--;
 	}
 
+	spin_unlock_irqrestore(&pad->ff_lock, flags);
+
 	return 0;
 }
 
 static int psxpad_spi_init_ff(struct psxpad *pad)
 {
+	struct input_dev *idev = pad->idev;
 	int err;
 
-	input_set_capability(pad->pdev->input, EV_FF, FF_RUMBLE);
+	spin_lock_init(&pad->ff_lock);
+
+	input_set_capability(idev, EV_FF, FF_RUMBLE);
+	input_set_capability(idev, EV_FF, FF_CONSTANT);
+	input_set_capability(idev, EV_FF, FF_PERIODIC);
+	__set_bit(FF_SQUARE, idev->ffbit);
+	__set_bit(FF_TRIANGLE, idev->ffbit);
+	__set_bit(FF_SINE, idev->ffbit);
+	__set_bit(FF_SAW_UP, idev->ffbit);
+	__set_bit(FF_SAW_DOWN, idev->ffbit);
 
-	err = input_ff_create_memless(pad->pdev->input, NULL,
-				      psxpad_spi_play_effect);
+	err = input_ff_create(idev, PSXPAD_FF_EFFECTS);
 	if (err) {
 		dev_err(&pad->spi->dev,
-			"input_ff_create_memless() failed: %d\n", err);
+			"input_ff_create() failed: %d\n", err);
 		return err;
 	}
 
+	idev->ff->upload = psxpad_ff_upload;
+	/* the input core stops an effect through playback before erasing */
+	idev->ff->playback = psxpad_ff_playback;
+
 	return 0;
 }
 
@@ -178,212 +595,1497 @@ static void psxpad_control_motor(struct psxpad *pad,
 {
 }
 
+static inline int psxpad_configure_motor(struct psxpad *pad)
+{
+	return 0;
+}
+
 static void psxpad_set_motor_level(struct psxpad *pad,
 				   u8 motor1level, u8 motor2level)
 {
 }
 
+static inline void psxpad_ff_update(struct psxpad *pad, ktime_t now)
+{
+}
+
+static inline bool psxpad_ff_active(struct psxpad *pad)
+{
+	return false;
+}
+
 static inline int psxpad_spi_init_ff(struct psxpad *pad)
 {
 	return 0;
 }
 #endif	/* CONFIG_JOYSTICK_PSXPAD_SPI_FF */
 
-static void psxpad_spi_poll_open(struct input_polled_dev *pdev)
+/*
+ * Pressure mode (ID 0x79) needs analog mode first. It is only switched
+ * back off when the pad is in it, pads without it may not take 0x4F.
+ */
+static int psxpad_configure_pressure(struct psxpad *pad)
 {
-	struct psxpad *pad = pdev->private;
+	int err;
 
-	pm_runtime_get_sync(&pad->spi->dev);
-}
+	if (!pad->pressure) {
+		if (pad->mode != 0x79)
+			return 0;
 
-static void psxpad_spi_poll_close(struct input_polled_dev *pdev)
-{
-	struct psxpad *pad = pdev->private;
+		memcpy(pad->sendbuf, PSX_CMD_ALL_PRESSURE,
+		       sizeof(PSX_CMD_ALL_PRESSURE));
+		/* buttons and sticks only */
+		pad->sendbuf[3] = 0x3F;
+		pad->sendbuf[4] = 0x00;
+		pad->sendbuf[5] = 0x00;
+		return psxpad_command(pad, sizeof(PSX_CMD_ALL_PRESSURE));
+	}
+
+	memcpy(pad->sendbuf, PSX_CMD_AD_MODE, sizeof(PSX_CMD_AD_MODE));
+	err = psxpad_command(pad, sizeof(PSX_CMD_AD_MODE));
+	if (err)
+		return err;
 
-	pm_runtime_put_sync(&pad->spi->dev);
+	memcpy(pad->sendbuf, PSX_CMD_ALL_PRESSURE,
+	       sizeof(PSX_CMD_ALL_PRESSURE));
+	return psxpad_command(pad, sizeof(PSX_CMD_ALL_PRESSURE));
 }
 
-static void psxpad_spi_poll(struct input_polled_dev *pdev)
+/* everything the pad forgets when unplugged, in one config session */
+static void psxpad_configure(struct psxpad *pad)
 {
-	struct psxpad *pad = pdev->private;
-	struct input_dev *input = pdev->input;
-	u8 b_rsp3, b_rsp4;
 	int err;
 
-	psxpad_control_motor(pad, true, true);
-
-	memcpy(pad->sendbuf, PSX_CMD_POLL, sizeof(PSX_CMD_POLL));
-	pad->sendbuf[3] = pad->motor1enable ? pad->motor1level : 0x00;
-	pad->sendbuf[4] = pad->motor2enable ? pad->motor2level : 0x00;
-	err = psxpad_command(pad, sizeof(PSX_CMD_POLL));
+	memcpy(pad->sendbuf, PSX_CMD_ENTER_CFG, sizeof(PSX_CMD_ENTER_CFG));
+	err = psxpad_command(pad, sizeof(PSX_CMD_ENTER_CFG));
 	if (err) {
 		dev_err(&pad->spi->dev,
-			"%s: poll command failed mode: %d\n", __func__, err);
+			"%s: failed to enter config mode: %d\n",
+			__func__, err);
 		return;
 	}
 
-	switch (pad->response[1]) {
-	case 0xCE:	/* 0x73 : analog 1 */
-		/* button data is inverted */
-		b_rsp3 = ~pad->response[3];
-		b_rsp4 = ~pad->response[4];
-
-		input_report_abs(input, ABS_X, REVERSE_BIT(pad->response[7]));
-		input_report_abs(input, ABS_Y, REVERSE_BIT(pad->response[8]));
-		input_report_abs(input, ABS_RX, REVERSE_BIT(pad->response[5]));
-		input_report_abs(input, ABS_RY, REVERSE_BIT(pad->response[6]));
-		input_report_key(input, BTN_DPAD_UP, b_rsp3 & BIT(3));
-		input_report_key(input, BTN_DPAD_DOWN, b_rsp3 & BIT(1));
-		input_report_key(input, BTN_DPAD_LEFT, b_rsp3 & BIT(0));
-		input_report_key(input, BTN_DPAD_RIGHT, b_rsp3 & BIT(2));
-		input_report_key(input, BTN_X, b_rsp4 & BIT(3));
-		input_report_key(input, BTN_A, b_rsp4 & BIT(2));
-		input_report_key(input, BTN_B, b_rsp4 & BIT(1));
-		input_report_key(input, BTN_Y, b_rsp4 & BIT(0));
-		input_report_key(input, BTN_TL, b_rsp4 & BIT(5));
-		input_report_key(input, BTN_TR, b_rsp4 & BIT(4));
-		input_report_key(input, BTN_TL2, b_rsp4 & BIT(7));
-		input_report_key(input, BTN_TR2, b_rsp4 & BIT(6));
-		input_report_key(input, BTN_THUMBL, b_rsp3 & BIT(6));
-		input_report_key(input, BTN_THUMBR, b_rsp3 & BIT(5));
-		input_report_key(input, BTN_SELECT, b_rsp3 & BIT(7));
-		input_report_key(input, BTN_START, b_rsp3 & BIT(4));
-		break;
+	err = psxpad_configure_motor(pad);
+	if (err)
+		return;
 
-	case 0x82:	/* 0x41 : digital */
-		/* button data is inverted */
-		b_rsp3 = ~pad->response[3];
-		b_rsp4 = ~pad->response[4];
-
-		input_report_abs(input, ABS_X, 0x80);
-		input_report_abs(input, ABS_Y, 0x80);
-		input_report_abs(input, ABS_RX, 0x80);
-		input_report_abs(input, ABS_RY, 0x80);
-		input_report_key(input, BTN_DPAD_UP, b_rsp3 & BIT(3));
-		input_report_key(input, BTN_DPAD_DOWN, b_rsp3 & BIT(1));
-		input_report_key(input, BTN_DPAD_LEFT, b_rsp3 & BIT(0));
-		input_report_key(input, BTN_DPAD_RIGHT, b_rsp3 & BIT(2));
-		input_report_key(input, BTN_X, b_rsp4 & BIT(3));
-		input_report_key(input, BTN_A, b_rsp4 & BIT(2));
-		input_report_key(input, BTN_B, b_rsp4 & BIT(1));
-		input_report_key(input, BTN_Y, b_rsp4 & BIT(0));
-		input_report_key(input, BTN_TL, b_rsp4 & BIT(5));
-		input_report_key(input, BTN_TR, b_rsp4 & BIT(4));
-		input_report_key(input, BTN_TL2, b_rsp4 & BIT(7));
-		input_report_key(input, BTN_TR2, b_rsp4 & BIT(6));
-		input_report_key(input, BTN_THUMBL, false);
-		input_report_key(input, BTN_THUMBR, false);
-		input_report_key(input, BTN_SELECT, b_rsp3 & BIT(7));
-		input_report_key(input, BTN_START, b_rsp3 & BIT(4));
-		break;
+	err = psxpad_configure_pressure(pad);
+	if (err) {
+		dev_err(&pad->spi->dev,
+			"%s: failed to set pressure mode: %d\n",
+			__func__, err);
+		return;
+	}
+
+	memcpy(pad->sendbuf, PSX_CMD_EXIT_CFG, sizeof(PSX_CMD_EXIT_CFG));
+	err = psxpad_command(pad, sizeof(PSX_CMD_EXIT_CFG));
+	if (err) {
+		dev_err(&pad->spi->dev,
+			"%s: failed to exit config mode: %d\n",
+			__func__, err);
+		return;
 	}
 
-	input_sync(input);
+	pad->configured = true;
 }
 
-static int psxpad_spi_probe(struct spi_device *spi)
+/* low nibble of the mode ID is the number of 16-bit data words, 0 is 16 */
+static u8 psxpad_frame_len(u8 mode)
 {
-	struct psxpad *pad;
-	struct input_polled_dev *pdev;
-	struct input_dev *idev;
-	int err;
+	u8 words = (mode & 0x0F) ? : 16;
 
-	pad = devm_kzalloc(&spi->dev, sizeof(struct psxpad), GFP_KERNEL);
-	if (!pad)
-		return -ENOMEM;
-
-	pdev = input_allocate_polled_device();
-	if (!pdev) {
-		dev_err(&spi->dev, "failed to allocate input device\n");
-		return -ENOMEM;
-	}
+	return min_t(u8, 3 + words * 2, PSXPAD_FRAME_MAX);
+}
 
-	/* input poll device settings */
-	pad->pdev = pdev;
-	pad->spi = spi;
+static void psxpad_hist_add(struct psxpad *pad, int lat, ktime_t delta)
+{
+	s64 us = ktime_to_us(delta);
+	int bucket = us > 0 ? fls64(us) : 0;
 
-	pdev->private = pad;
-	pdev->open = psxpad_spi_poll_open;
-	pdev->close = psxpad_spi_poll_close;
-	pdev->poll = psxpad_spi_poll;
-	/* poll interval is about 60fps */
-	pdev->poll_interval = 16;
-	pdev->poll_interval_min = 8;
-	pdev->poll_interval_max = 32;
+	bucket = min(bucket, PSXPAD_HIST_BUCKETS - 1);
+	this_cpu_inc(pad->hist->count[lat][bucket]);
+}
 
-	/* input device settings */
-	idev = pdev->input;
-	idev->name = "PlayStation 1/2 joypad";
-	snprintf(pad->phys, sizeof(pad->phys), "%s/input", dev_name(&spi->dev));
-	idev->id.bustype = BUS_SPI;
+static const unsigned short psxpad_buttons[16] = {
+	BTN_SELECT, BTN_THUMBL, BTN_THUMBR, BTN_START,
+	BTN_DPAD_UP, BTN_DPAD_RIGHT, BTN_DPAD_DOWN, BTN_DPAD_LEFT,
+	BTN_TL2, BTN_TR2, BTN_TL, BTN_TR,
+	BTN_X, BTN_A, BTN_B, BTN_Y,
+};
 
-	/* key/value map settings */
-	input_set_abs_params(idev, ABS_X, 0, 255, 0, 0);
-	input_set_abs_params(idev, ABS_Y, 0, 255, 0, 0);
-	input_set_abs_params(idev, ABS_RX, 0, 255, 0, 0);
-	input_set_abs_params(idev, ABS_RY, 0, 255, 0, 0);
-	input_set_capability(idev, EV_KEY, BTN_DPAD_UP);
-	input_set_capability(idev, EV_KEY, BTN_DPAD_DOWN);
-	input_set_capability(idev, EV_KEY, BTN_DPAD_LEFT);
-	input_set_capability(idev, EV_KEY, BTN_DPAD_RIGHT);
-	input_set_capability(idev, EV_KEY, BTN_A);
-	input_set_capability(idev, EV_KEY, BTN_B);
-	input_set_capability(idev, EV_KEY, BTN_X);
-	input_set_capability(idev, EV_KEY, BTN_Y);
-	input_set_capability(idev, EV_KEY, BTN_TL);
-	input_set_capability(idev, EV_KEY, BTN_TR);
-	input_set_capability(idev, EV_KEY, BTN_TL2);
-	input_set_capability(idev, EV_KEY, BTN_TR2);
-	input_set_capability(idev, EV_KEY, BTN_THUMBL);
-	input_set_capability(idev, EV_KEY, BTN_THUMBR);
-	input_set_capability(idev, EV_KEY, BTN_SELECT);
-	input_set_capability(idev, EV_KEY, BTN_START);
+static const unsigned int psxpad_axes[4] = {
+	ABS_X, ABS_Y, ABS_RX, ABS_RY,
+};
 
-	err = psxpad_spi_init_ff(pad);
-	if (err)
-		return err;
+/*
+ * Pressure bytes in frame order: right, left, up, down, triangle, circle,
+ * cross, square, L1, R1, L2, R2. Kept off the ABS_HAT axes, which are
+ * read as d-pads; ABS_MISC + 1..5 are unnamed but below the MT range.
+ */
+static const unsigned int psxpad_pressure_axes[12] = {
+	ABS_MISC, ABS_MISC + 1, ABS_MISC + 2, ABS_MISC + 3,
+	ABS_MISC + 4, ABS_MISC + 5, ABS_BRAKE, ABS_GAS,
+	ABS_THROTTLE, ABS_RUDDER, ABS_Z, ABS_RZ,
+};
 
-	/* SPI settings */
-	spi->mode = SPI_MODE_3;
-	spi->bits_per_word = 8;
-	/* (PlayStation 1/2 joypad might be possible works 250kHz/500kHz) */
-	spi->master->min_speed_hz = 125000;
-	spi->master->max_speed_hz = 125000;
-	spi_setup(spi);
+/*
+ * How to decode each controller type: frame length it needs, which bits
+ * of data bytes 3-4 are buttons it has, the frame offset of ABS_X, ABS_Y,
+ * ABS_RX, ABS_RY (0 reports a centered axis) and of the 12 pressure bytes
+ * (0 reports them released). Guitars identify as digital or analog.
+ */
+struct psxpad_desc {
+	u8 mode;
+	u8 len;
+	u16 buttons;
+	u8 axes[4];
+	u8 pressure;
+};
 
-	/* pad settings */
-	psxpad_set_motor_level(pad, 0, 0);
+static const struct psxpad_desc psxpad_descs[] = {
+	{ 0x41,  5, 0xFFF9, { 0, 0, 0, 0 }, 0 },	/* digital, no L3/R3 */
+	{ 0x73,  9, 0xFFFF, { 7, 8, 5, 6 }, 0 },	/* DualShock */
+	{ 0x79, 21, 0xFFFF, { 7, 8, 5, 6 }, 9 },	/* DualShock 2 */
+	{ 0x53,  9, 0xFFFF, { 7, 8, 5, 6 }, 0 },	/* analog joystick */
+	/* NeGcon: twist, L, I, II */
+	{ 0x23,  9, 0x38F8, { 5, 8, 6, 7 }, 0 },
+	/* mouse, motion is relative and not reported */
+	{ 0x12,  7, 0x0C00, { 0, 0, 0, 0 }, 0 },
+};
 
-	/* register input poll device */
-	err = input_register_polled_device(pdev);
-	if (err) {
-		dev_err(&spi->dev,
-			"failed to register input poll device: %d\n", err);
-		return err;
-	}
+static const struct psxpad_desc *psxpad_find_desc(u8 mode)
+{
+	int i;
 
-	pm_runtime_enable(&spi->dev);
+	for (i = 0; i < ARRAY_SIZE(psxpad_descs); i++)
+		if (psxpad_descs[i].mode == mode)
+			return &psxpad_descs[i];
 
-	return 0;
+	return NULL;
 }
 
-static int __maybe_unused psxpad_spi_suspend(struct device *dev)
+/* rsp[1] is the mode ID, rsp[2] the 0x5A marker, data follows */
+static bool psxpad_decode(const u8 *rsp, unsigned int len,
+			  struct psxpad_state *state)
 {
-	struct spi_device *spi = to_spi_device(dev);
-	struct psxpad *pad = spi_get_drvdata(spi);
+	const struct psxpad_desc *desc = psxpad_find_desc(rsp[1]);
+	int i;
 
-	psxpad_set_motor_level(pad, 0, 0);
+	/* a multitap slot is too short for a pressure frame */
+	if (!desc || desc->len > len)
+		return false;
 
-	return 0;
-}
+	/* button data is inverted */
+	state->buttons = ~(rsp[3] | rsp[4] << 8) & desc->buttons;
+	for (i = 0; i < ARRAY_SIZE(state->axes); i++)
+		state->axes[i] = desc->axes[i] ? rsp[desc->axes[i]] : 0x80;
 
-static SIMPLE_DEV_PM_OPS(psxpad_spi_pm, psxpad_spi_suspend, NULL);
+	if (desc->pressure)
+		memcpy(state->pressure, rsp + desc->pressure,
+		       sizeof(state->pressure));
+	else
+		memset(state->pressure, 0, sizeof(state->pressure));
 
-static const struct spi_device_id psxpad_spi_id[] = {
-	{ "psxpad-spi", 0 },
-	{ }
-};
-MODULE_DEVICE_TABLE(spi, psxpad_spi_id);
+	return true;
+}
+
+/* report what changed since the last frame, true if anything did */
+static bool psxpad_report(struct input_dev *input, struct psxpad_state *last,
+			  const u8 *rsp, unsigned int len)
+{
+	struct psxpad_state state;
+	unsigned long changed;
+	bool synced = true;
+	int i;
+
+	if (!psxpad_decode(rsp, len, &state))
+		return false;
+
+	changed = state.buttons ^ last->buttons;
+	for_each_set_bit(i, &changed, ARRAY_SIZE(psxpad_buttons))
+		input_report_key(input, psxpad_buttons[i],
+				 state.buttons & BIT(i));
+
+	for (i = 0; i < ARRAY_SIZE(psxpad_axes); i++) {
+		if (state.axes[i] == last->axes[i])
+			continue;
+		input_report_abs(input, psxpad_axes[i], state.axes[i]);
+		synced = false;
+	}
+
+	/* only port A has the pressure axes, others never see 0x79 */
+	for (i = 0; i < ARRAY_SIZE(psxpad_pressure_axes); i++) {
+		if (state.pressure[i] == last->pressure[i])
+			continue;
+		input_report_abs(input, psxpad_pressure_axes[i],
+				 state.pressure[i]);
+		synced = false;
+	}
+
+	*last = state;
+
+	return changed || !synced;
+}
+
+static void psxpad_poll_done(struct psxpad *pad)
+{
+	clear_bit_unlock(PSXPAD_POLL_BUSY, &pad->flags);
+	wake_up_var(&pad->flags);
+}
+
+static irqreturn_t psxpad_ack_irq(int irq, void *data)
+{
+	struct psxpad *pad = data;
+
+	/* the pad has latched its state once it acks the first byte */
+	if (atomic_inc_return(&pad->acks) == 1)
+		WRITE_ONCE(pad->ack_stamp, ktime_get());
+
+	return IRQ_HANDLED;
+}
+
+static int psxpad_frame_submit(struct psxpad *pad, struct psxpad_frame *frame)
+{
+	frame->xfer.speed_hz = psxpad_speeds[pad->speed];
+	frame->submitted = ktime_get();
+	atomic_set(&pad->acks, 0);
+
+	return spi_async(pad->spi, &frame->msg);
+}
+
+/*
+ * Step the clock up after a run of good frames, and down on a bad one.
+ * A speed that failed is not tried again until the device is reopened.
+ */
+static void psxpad_speed_update(struct psxpad *pad, bool good)
+{
+	if (!pad->ack_gpio)
+		return;
+
+	if (!good) {
+		pad->speed_good = 0;
+		if (pad->speed) {
+			pad->speed_max = --pad->speed;
+			dev_dbg(&pad->spi->dev, "clock down to %u Hz\n",
+				psxpad_speeds[pad->speed]);
+		}
+		return;
+	}
+
+	if (pad->speed < pad->speed_max &&
+	    ++pad->speed_good >= PSXPAD_SPEED_STEP_FRAMES) {
+		pad->speed_good = 0;
+		pad->speed++;
+		dev_dbg(&pad->spi->dev, "clock up to %u Hz\n",
+			psxpad_speeds[pad->speed]);
+	}
+}
+
+/* frames without a full set of ACK pulses were clocked too fast */
+static bool psxpad_frame_acked(struct psxpad *pad, struct psxpad_frame *frame)
+{
+	return !pad->ack_gpio ||
+	       atomic_read(&pad->acks) >= frame->xfer.len - 1;
+}
+
+/* mode IDs are type in the high nibble and data word count in the low */
+static bool psxpad_mode_valid(u8 mode)
+{
+	switch (mode >> 4) {
+	case 0x1:	/* mouse */
+	case 0x2:	/* NeGcon */
+	case 0x4:	/* digital */
+	case 0x5:	/* analog joystick */
+	case 0x6:	/* lightgun */
+	case 0x7:	/* analog, DualShock */
+	case 0x8:	/* multitap */
+	case 0xE:	/* JogCon */
+	case 0xF:	/* config mode */
+		return true;
+	}
+
+	return false;
+}
+
+static u8 *psxpad_trace_varint(u8 *p, u64 val)
+{
+	while (val >= 0x80) {
+		*p++ = (val & 0x7F) | 0x80;
+		val >>= 7;
+	}
+	*p++ = val;
+
+	return p;
+}
+
+static void psxpad_trace_frame(struct psxpad *pad, const u8 *rsp, u8 len,
+			       ktime_t stamp)
+{
+	struct psxpad_trace *trace = &pad->trace;
+	u8 buf[PSXPAD_TRACE_RECORD_MAX], *p = buf, *mask;
+	u64 now = ktime_to_ns(stamp);
+	unsigned long flags;
+	bool changed;
+	unsigned int i;
+
+	spin_lock_irqsave(&trace->lock, flags);
+	if (!trace->on)
+		goto out;
+
+	changed = trace->resync || len != trace->len ||
+		  memcmp(rsp, trace->frame, len);
+	if (!changed) {
+		trace->run++;
+		trace->run_ns = now;
+		/* an idle pad would hold its run back, flush once a second */
+		if (now - trace->last < NSEC_PER_SEC && trace->run != U32_MAX)
+			goto out;
+	}
+
+	if (trace->resync) {
+		*p++ = PSXPAD_TRACE_RESYNC;
+		p = psxpad_trace_varint(p, now - trace->start);
+		trace->last = now;
+		trace->run = 0;
+		trace->len = 0;
+		memset(trace->frame, 0, sizeof(trace->frame));
+	}
+
+	if (trace->run) {
+		*p++ = PSXPAD_TRACE_REPEAT;
+		p = psxpad_trace_varint(p, trace->run);
+		p = psxpad_trace_varint(p, trace->run_ns - trace->last);
+		trace->last = trace->run_ns;
+		trace->run = 0;
+	}
+
+	if (changed) {
+		*p++ = PSXPAD_TRACE_CYCLE;
+		p = psxpad_trace_varint(p, now - trace->last);
+		*p++ = 1;
+		*p++ = len;
+		mask = p;
+		memset(mask, 0, DIV_ROUND_UP(len, 8));
+		p += DIV_ROUND_UP(len, 8);
+		for (i = 0; i < len; i++) {
+			if (rsp[i] == trace->frame[i])
+				continue;
+			mask[i / 8] |= BIT(i % 8);
+			*p++ = rsp[i];
+		}
+		memcpy(trace->frame, rsp, len);
+		trace->len = len;
+		trace->last = now;
+	}
+
+	if (kfifo_avail(&trace->fifo) < p - buf) {
+		trace->resync = true;
+	} else {
+		kfifo_in(&trace->fifo, buf, p - buf);
+		trace->resync = false;
+		wake_up_interruptible(&trace->wait);
+	}
+out:
+	spin_unlock_irqrestore(&trace->lock, flags);
+}
+
+static void psxpad_poll_complete(void *context)
+{
+	struct psxpad_frame *frame = context;
+	struct psxpad *pad = frame->pad;
+	u8 *rsp = frame->response;
+	ktime_t done = ktime_get();
+	ktime_t stamp, synced;
+	const u8 *slot;
+	unsigned long flags;
+	unsigned int changed = 0;
+	bool reconfig = false;
+	u8 len;
+	int i;
+
+	psxpad_hist_add(pad, PSXPAD_LAT_XFER,
+			ktime_sub(done, frame->submitted));
+
+	if (frame->msg.status) {
+		dev_err_ratelimited(&pad->spi->dev,
+				    "%s: poll command failed mode: %d\n",
+				    __func__, frame->msg.status);
+		pad->stats.bad_frames++;
+		psxpad_speed_update(pad, false);
+		psxpad_poll_done(pad);
+		return;
+	}
+
+	psxpad_bitrev(pad, rsp, frame->xfer.len);
+
+	/* a short frame is fetched again in full below, that one is traced */
+	if (unlikely(test_bit(PSXPAD_TRACING, &pad->flags)) &&
+	    (rsp[2] != 0x5A || psxpad_frame_len(rsp[1]) <= frame->xfer.len))
+		psxpad_trace_frame(pad, rsp, frame->xfer.len, done);
+
+	/*
+	 * The pad forgets its config when it is unplugged (no 0x5A marker).
+	 * A pad that vanishes between two frames may also have lost sync
+	 * with the clock, so slow down as well.
+	 */
+	if (rsp[2] != 0x5A) {
+		if (pad->present) {
+			pad->present = false;
+			pad->stats.disconnects++;
+			psxpad_speed_update(pad, false);
+		}
+		pad->configured = false;
+		psxpad_poll_done(pad);
+		return;
+	}
+
+	/* drop garbage before it can touch the input state */
+	len = psxpad_frame_len(rsp[1]);
+	if (!psxpad_mode_valid(rsp[1]) || !psxpad_frame_acked(pad, frame)) {
+		pad->stats.bad_frames++;
+		psxpad_speed_update(pad, false);
+		psxpad_poll_done(pad);
+		return;
+	}
+
+	/*
+	 * Only as many bytes as the pad sent in its last frame are clocked
+	 * out (5 digital, 9 analog, 21 pressure, 35 multitap). If the mode
+	 * ID now asks for more, fetch the full frame right away.
+	 */
+	if (len > frame->xfer.len) {
+		pad->stats.retries++;
+		pad->polllen = len;
+		frame->xfer.len = len;
+		if (psxpad_frame_submit(pad, frame))
+			psxpad_poll_done(pad);
+		return;
+	}
+
+	if (!pad->present)
+		WRITE_ONCE(pad->last_change, done);
+	pad->present = true;
+	pad->stats.good_frames++;
+	psxpad_speed_update(pad, true);
+	pad->polllen = len;
+
+	/*
+	 * The pad may also forget its config when its type (high nibble of
+	 * the mode ID) changes. 0x73 and 0x79 are the same type, that is
+	 * its own pressure config taking effect and needs no second session.
+	 */
+	if (!pad->configured || (rsp[1] >> 4) != (pad->mode >> 4))
+		reconfig = true;
+	pad->mode = rsp[1];
+
+	/* let the next frame go on the bus while this one is decoded */
+	if (!reconfig)
+		psxpad_poll_done(pad);
+
+	spin_lock_irqsave(&pad->report_lock, flags);
+	if (pad->multitap && rsp[1] == 0x80) {
+		/* each slot has the layout of a frame without the HiZ byte */
+		for (i = 0; i < PSXPAD_TAP_PORTS; i++) {
+			slot = rsp + 2 + i * PSXPAD_TAP_SLOT_LEN;
+			if (pad->tap_input[i] && slot[2] == 0x5A &&
+			    psxpad_report(pad->tap_input[i], &pad->state[i],
+					  slot, PSXPAD_TAP_SLOT_LEN + 1))
+				changed |= BIT(i);
+		}
+	} else if (psxpad_report(pad->idev, &pad->state[0], rsp, len)) {
+		changed = BIT(0);
+	}
+	psxpad_hist_add(pad, PSXPAD_LAT_DECODE, ktime_sub(ktime_get(), done));
+	if (changed)
+		WRITE_ONCE(pad->last_change, done);
+
+	/*
+	 * Events carry the time the pad was sampled, not that of input_sync():
+	 * the ACK edge when there is a line for it, else the SPI completion.
+	 */
+	stamp = pad->ack_gpio ? READ_ONCE(pad->ack_stamp) : done;
+
+	/* identical frames don't wake up the readers */
+	for (i = 0; i < PSXPAD_TAP_PORTS; i++) {
+		if (changed & BIT(i)) {
+			input_set_timestamp(pad->tap_input[i], stamp);
+			input_sync(pad->tap_input[i]);
+		}
+	}
+	synced = ktime_get();
+	psxpad_hist_add(pad, PSXPAD_LAT_SYNC, ktime_sub(synced, done));
+	if (changed)
+		psxpad_hist_add(pad, PSXPAD_LAT_SAMPLE,
+				ktime_sub(synced, stamp));
+	spin_unlock_irqrestore(&pad->report_lock, flags);
+
+	/* config needs several synchronous commands, polling waits for it */
+	if (reconfig)
+		schedule_work(&pad->config_work);
+}
+
+static void psxpad_set_capabilities(struct input_dev *idev)
+{
+	input_set_abs_params(idev, ABS_X, 0, 255, 0, 0);
+	input_set_abs_params(idev, ABS_Y, 0, 255, 0, 0);
+	input_set_abs_params(idev, ABS_RX, 0, 255, 0, 0);
+	input_set_abs_params(idev, ABS_RY, 0, 255, 0, 0);
+	input_set_capability(idev, EV_KEY, BTN_DPAD_UP);
+	input_set_capability(idev, EV_KEY, BTN_DPAD_DOWN);
+	input_set_capability(idev, EV_KEY, BTN_DPAD_LEFT);
+	input_set_capability(idev, EV_KEY, BTN_DPAD_RIGHT);
+	input_set_capability(idev, EV_KEY, BTN_A);
+	input_set_capability(idev, EV_KEY, BTN_B);
+	input_set_capability(idev, EV_KEY, BTN_X);
+	input_set_capability(idev, EV_KEY, BTN_Y);
+	input_set_capability(idev, EV_KEY, BTN_TL);
+	input_set_capability(idev, EV_KEY, BTN_TR);
+	input_set_capability(idev, EV_KEY, BTN_TL2);
+	input_set_capability(idev, EV_KEY, BTN_TR2);
+	input_set_capability(idev, EV_KEY, BTN_THUMBL);
+	input_set_capability(idev, EV_KEY, BTN_THUMBR);
+	input_set_capability(idev, EV_KEY, BTN_SELECT);
+	input_set_capability(idev, EV_KEY, BTN_START);
+}
+
+/*
+ * Ports B-D get their own input devices the first time a multitap is
+ * seen. They are polled together with port A, while its device is open.
+ */
+static void psxpad_register_tap(struct psxpad *pad)
+{
+	struct input_dev *idev;
+	int i, err;
+
+	for (i = 1; i < PSXPAD_TAP_PORTS; i++) {
+		if (pad->tap_input[i])
+			continue;
+
+		idev = devm_input_allocate_device(&pad->spi->dev);
+		if (!idev) {
+			dev_err(&pad->spi->dev,
+				"failed to allocate multitap input device\n");
+			return;
+		}
+
+		idev->name = "PlayStation 1/2 joypad (multitap)";
+		snprintf(pad->tap_phys[i], sizeof(pad->tap_phys[i]),
+			 "%s/input%d", dev_name(&pad->spi->dev), i);
+		idev->phys = pad->tap_phys[i];
+		idev->id.bustype = BUS_SPI;
+		psxpad_set_capabilities(idev);
+
+		err = input_register_device(idev);
+		if (err) {
+			dev_err(&pad->spi->dev,
+				"failed to register multitap input device: %d\n",
+				err);
+			return;
+		}
+
+		pad->tap_input[i] = idev;
+	}
+}
+
+static void psxpad_detect_multitap(struct psxpad *pad)
+{
+	int err;
+
+	memcpy(pad->sendbuf, PSX_CMD_TAP_POLL, sizeof(PSX_CMD_TAP_POLL));
+	err = psxpad_command(pad, sizeof(PSX_CMD_TAP_POLL));
+	if (err)
+		return;
+
+	pad->multitap = pad->response[2] == 0x5A &&
+			pad->response[1] == 0x80;
+	if (pad->multitap)
+		psxpad_register_tap(pad);
+}
+
+static void psxpad_config_work(struct work_struct *work)
+{
+	struct psxpad *pad = container_of(work, struct psxpad, config_work);
+
+	/* a multitap hides its pads' config, only port A's frame is used */
+	psxpad_detect_multitap(pad);
+	if (pad->multitap)
+		pad->configured = true;
+	else
+		psxpad_configure(pad);
+
+	psxpad_poll_done(pad);
+}
+
+static void psxpad_poll_submit(struct psxpad *pad)
+{
+	struct psxpad_frame *frame;
+	int err;
+
+	if (test_bit(PSXPAD_SUSPENDED, &pad->flags))
+		return;
+
+	/* a frame still on the bus or a pending config skips this tick */
+	if (test_and_set_bit_lock(PSXPAD_POLL_BUSY, &pad->flags))
+		return;
+
+	frame = &pad->frames[pad->frame];
+	pad->frame ^= 1;
+
+	psxpad_ff_update(pad, ktime_get());
+
+	/* the rest of the frame was put in wire order by psxpad_init_frames */
+	if (pad->multitap) {
+		/* these bytes fall on port A's slot, motors aren't driven */
+		frame->sendbuf[2] = psxpad_wire(pad, PSX_CMD_TAP_POLL[2]);
+		frame->sendbuf[3] = 0x00;
+		frame->sendbuf[4] = 0x00;
+		frame->motor_gen = pad->motor_gen - 1;
+	} else if (frame->motor_gen != pad->motor_gen) {
+		frame->sendbuf[2] = psxpad_wire(pad, PSX_CMD_POLL[2]);
+		frame->sendbuf[3] = pad->motor1enable ?
+				    psxpad_wire(pad, pad->motor1level) : 0x00;
+		frame->sendbuf[4] = pad->motor2enable ?
+				    psxpad_wire(pad, pad->motor2level) : 0x00;
+		frame->motor_gen = pad->motor_gen;
+	}
+	frame->xfer.len = pad->polllen;
+
+	err = psxpad_frame_submit(pad, frame);
+	if (err) {
+		dev_err_ratelimited(&pad->spi->dev,
+				    "%s: poll command failed mode: %d\n",
+				    __func__, err);
+		psxpad_poll_done(pad);
+	}
+}
+
+static void psxpad_init_frames(struct psxpad *pad)
+{
+	struct psxpad_frame *frame;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(pad->frames); i++) {
+		frame = &pad->frames[i];
+		frame->pad = pad;
+		memcpy(frame->sendbuf, PSX_CMD_POLL, sizeof(PSX_CMD_POLL));
+		psxpad_bitrev(pad, frame->sendbuf, sizeof(PSX_CMD_POLL));
+		frame->xfer.tx_buf = frame->sendbuf;
+		frame->xfer.rx_buf = frame->response;
+		frame->xfer.len = sizeof(PSX_CMD_POLL);
+		spi_message_init_with_transfers(&frame->msg, &frame->xfer, 1);
+		frame->msg.complete = psxpad_poll_complete;
+		frame->msg.context = frame;
+	}
+}
+
+/* interval until the next poll, stretched while the pad sits idle */
+static u32 psxpad_poll_interval_us(struct psxpad *pad, u32 base, ktime_t now)
+{
+	u32 timeout = READ_ONCE(pad->idle_timeout_ms);
+	s64 idle;
+
+	/* effects are timed by the poll clock */
+	if (!timeout || psxpad_ff_active(pad))
+		return base;
+
+	idle = ktime_ms_delta(now, READ_ONCE(pad->last_change));
+	if (idle < timeout)
+		return base;
+	if (!READ_ONCE(pad->present))
+		return max_t(u32, base, PSXPAD_HOTPLUG_INTERVAL_US);
+	if (idle < 2 * (s64)timeout)
+		return max_t(u32, base, PSXPAD_IDLE_INTERVAL_US);
+
+	return max_t(u32, base, PSXPAD_IDLE_INTERVAL2_US);
+}
+
+/*
+ * While the polls are far apart the pad drops its runtime PM reference,
+ * so the SPI controller can autosuspend between them. The SPI core
+ * resumes it for every message. Both calls are async, safe from the timer.
+ */
+static void psxpad_pm_update(struct psxpad *pad, u32 interval)
+{
+	bool idle = interval >= PSXPAD_IDLE_INTERVAL_US;
+
+	if (idle == test_bit(PSXPAD_PM_IDLE, &pad->flags))
+		return;
+
+	if (idle) {
+		set_bit(PSXPAD_PM_IDLE, &pad->flags);
+		pm_runtime_mark_last_busy(&pad->spi->dev);
+		pm_runtime_put_autosuspend(&pad->spi->dev);
+	} else {
+		clear_bit(PSXPAD_PM_IDLE, &pad->flags);
+		pm_runtime_get(&pad->spi->dev);
+	}
+}
+
+/* workqueue engine, the interval is rounded up to jiffies */
+static void psxpad_poll_work(struct work_struct *work)
+{
+	struct psxpad *pad = container_of(to_delayed_work(work),
+					  struct psxpad, poll_work);
+	u32 interval = PSXPAD_POLL_INTERVAL_MS * USEC_PER_MSEC;
+
+	psxpad_poll_submit(pad);
+
+	interval = psxpad_poll_interval_us(pad, interval, ktime_get());
+	queue_delayed_work(pad->bus->wq, &pad->poll_work,
+			   usecs_to_jiffies(interval));
+	psxpad_pm_update(pad, interval);
+}
+
+/*
+ * hrtimer engine: polls are submitted with spi_async() straight from the
+ * timer, so the interval is neither quantised to jiffies nor delayed by
+ * workqueue scheduling, and no thread has to wake up per poll.
+ *
+ * One timer serves every open pad on an SPI controller. Pads are
+ * staggered across the cycle: each gets its own slot of the shortest
+ * interval, so the bus carries one frame at a time instead of a burst.
+ * A pad's deadline advances from its last one so it keeps its slot.
+ * The timer ticks once per slot, pads with a longer interval are skipped
+ * until their deadline. Idle pads stretch their interval, so a bus with
+ * only idle pads wakes up rarely.
+ */
+static enum hrtimer_restart psxpad_bus_timer(struct hrtimer *timer)
+{
+	struct psxpad_bus *bus = container_of(timer, struct psxpad_bus, timer);
+	ktime_t now = hrtimer_cb_get_time(timer);
+	ktime_t late = ktime_sub(now, hrtimer_get_expires(timer));
+	u32 tick = PSXPAD_HOTPLUG_INTERVAL_US;
+	unsigned int npads = 0;
+	struct psxpad *pad;
+	ktime_t due;
+	u32 interval;
+
+	spin_lock(&bus->pads_lock);
+
+	list_for_each_entry(pad, &bus->pads, bus_node) {
+		interval = psxpad_poll_interval_us(pad,
+				READ_ONCE(pad->poll_interval_us), now);
+		tick = min_t(u32, tick, interval);
+		npads++;
+	}
+	tick = max_t(u32, tick, PSXPAD_POLL_INTERVAL_US_MIN);
+	/* one slot per pad */
+	if (npads)
+		tick /= npads;
+
+	/* half a slot of slack so timer jitter doesn't skip a whole slot */
+	due = ktime_add_us(now, tick / 2);
+	list_for_each_entry(pad, &bus->pads, bus_node) {
+		if (ktime_after(pad->next_poll, due))
+			continue;
+
+		interval = psxpad_poll_interval_us(pad,
+				READ_ONCE(pad->poll_interval_us), now);
+		interval = max_t(u32, interval, PSXPAD_POLL_INTERVAL_US_MIN);
+		pad->next_poll = ktime_add_us(pad->next_poll, interval);
+		if (ktime_before(pad->next_poll, now))
+			pad->next_poll = ktime_add_us(now, interval);
+		psxpad_hist_add(pad, PSXPAD_LAT_WAKE, late);
+		psxpad_poll_submit(pad);
+		psxpad_pm_update(pad, interval);
+	}
+
+	/* pads that land in the same slot take turns going first */
+	if (!list_empty(&bus->pads))
+		list_rotate_left(&bus->pads);
+
+	spin_unlock(&bus->pads_lock);
+
+	/* missed deadlines are skipped, not caught up */
+	hrtimer_forward_now(timer, us_to_ktime(tick));
+
+	return HRTIMER_RESTART;
+}
+
+/* pad i of n polls i/n of its interval into the cycle */
+static void psxpad_bus_stagger(struct psxpad_bus *bus)
+{
+	ktime_t now = ktime_get();
+	unsigned int npads = 0, i = 0;
+	struct psxpad *pad;
+	u32 interval;
+
+	list_for_each_entry(pad, &bus->pads, bus_node)
+		npads++;
+
+	list_for_each_entry(pad, &bus->pads, bus_node) {
+		interval = max_t(u32, READ_ONCE(pad->poll_interval_us),
+				 PSXPAD_POLL_INTERVAL_US_MIN);
+		pad->next_poll = ktime_add_us(now, interval / npads * i++);
+	}
+}
+
+static void psxpad_bus_attach(struct psxpad *pad)
+{
+	struct psxpad_bus *bus = pad->bus;
+	bool first;
+
+	mutex_lock(&bus->lock);
+
+	spin_lock_irq(&bus->pads_lock);
+	first = list_empty(&bus->pads);
+	list_add_tail(&pad->bus_node, &bus->pads);
+	psxpad_bus_stagger(bus);
+	spin_unlock_irq(&bus->pads_lock);
+
+	if (first)
+		hrtimer_start(&bus->timer, 0, HRTIMER_MODE_REL);
+
+	mutex_unlock(&bus->lock);
+}
+
+static void psxpad_bus_detach(struct psxpad *pad)
+{
+	struct psxpad_bus *bus = pad->bus;
+	bool last;
+
+	mutex_lock(&bus->lock);
+
+	spin_lock_irq(&bus->pads_lock);
+	list_del_init(&pad->bus_node);
+	last = list_empty(&bus->pads);
+	if (!last)
+		psxpad_bus_stagger(bus);
+	spin_unlock_irq(&bus->pads_lock);
+
+	if (last)
+		hrtimer_cancel(&bus->timer);
+
+	mutex_unlock(&bus->lock);
+}
+
+static struct psxpad_bus *psxpad_bus_get(struct spi_controller *ctlr)
+{
+	struct psxpad_bus *bus;
+
+	mutex_lock(&psxpad_buses_lock);
+
+	list_for_each_entry(bus, &psxpad_buses, node) {
+		if (bus->ctlr == ctlr) {
+			bus->refcount++;
+			goto out;
+		}
+	}
+
+	bus = kzalloc(sizeof(*bus), GFP_KERNEL);
+	if (!bus)
+		goto out;
+
+	bus->ctlr = ctlr;
+	bus->refcount = 1;
+	mutex_init(&bus->lock);
+	spin_lock_init(&bus->pads_lock);
+	INIT_LIST_HEAD(&bus->pads);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+	hrtimer_setup(&bus->timer, psxpad_bus_timer, CLOCK_MONOTONIC,
+		      HRTIMER_MODE_REL);
+#else
+	hrtimer_init(&bus->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	bus->timer.function = psxpad_bus_timer;
+#endif
+
+	bus->wq = alloc_workqueue("psxpad-%s",
+				  WQ_HIGHPRI | WQ_UNBOUND | WQ_FREEZABLE, 0,
+				  dev_name(&ctlr->dev));
+	if (!bus->wq) {
+		kfree(bus);
+		bus = NULL;
+		goto out;
+	}
+
+	list_add(&bus->node, &psxpad_buses);
+
+out:
+	mutex_unlock(&psxpad_buses_lock);
+
+	return bus;
+}
+
+static void psxpad_bus_put(void *data)
+{
+	struct psxpad_bus *bus = data;
+
+	mutex_lock(&psxpad_buses_lock);
+
+	if (!--bus->refcount) {
+		list_del(&bus->node);
+		destroy_workqueue(bus->wq);
+		kfree(bus);
+	}
+
+	mutex_unlock(&psxpad_buses_lock);
+}
+
+static int psxpad_spi_open(struct input_dev *idev)
+{
+	struct psxpad *pad = input_get_drvdata(idev);
+
+	pm_runtime_get_sync(&pad->spi->dev);
+
+	/* failed clock steps are retried on every open */
+	pad->speed = 0;
+	pad->speed_good = 0;
+	pad->speed_max = pad->ack_gpio ? PSXPAD_SPEED_LAST : 0;
+	while (pad->speed_max &&
+	       psxpad_speeds[pad->speed_max] > pad->spi->max_speed_hz)
+		pad->speed_max--;
+
+	/* start at the full rate, idle back-off counts from here */
+	pad->last_change = ktime_get();
+
+	/*
+	 * a pad swapped while closed may report the same mode ID, config is
+	 * sent again on the first poll as after resume
+	 */
+	pad->configured = false;
+
+	/* switching between the engines takes effect on the next open */
+	if (pad->poll_interval_us)
+		psxpad_bus_attach(pad);
+	else
+		queue_delayed_work(pad->bus->wq, &pad->poll_work, 0);
+
+	return 0;
+}
+
+static void psxpad_spi_close(struct input_dev *idev)
+{
+	struct psxpad *pad = input_get_drvdata(idev);
+
+	if (!list_empty(&pad->bus_node))
+		psxpad_bus_detach(pad);
+	else
+		cancel_delayed_work_sync(&pad->poll_work);
+	/* wait for the frame on the bus and any config it triggered */
+	wait_var_event(&pad->flags,
+		       !test_bit(PSXPAD_POLL_BUSY, &pad->flags));
+
+	/* already dropped if polling had backed off */
+	if (!test_and_clear_bit(PSXPAD_PM_IDLE, &pad->flags)) {
+		pm_runtime_mark_last_busy(&pad->spi->dev);
+		pm_runtime_put_autosuspend(&pad->spi->dev);
+	}
+}
+
+static ssize_t poll_interval_us_show(struct device *dev,
+				     struct device_attribute *attr, char *buf)
+{
+	struct psxpad *pad = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", READ_ONCE(pad->poll_interval_us));
+}
+
+static ssize_t poll_interval_us_store(struct device *dev,
+				      struct device_attribute *attr,
+				      const char *buf, size_t count)
+{
+	struct psxpad *pad = dev_get_drvdata(dev);
+	u32 interval;
+	int err;
+
+	err = kstrtou32(buf, 0, &interval);
+	if (err)
+		return err;
+
+	if (interval && (interval < PSXPAD_POLL_INTERVAL_US_MIN ||
+			 interval > PSXPAD_POLL_INTERVAL_US_MAX))
+		return -EINVAL;
+
+	WRITE_ONCE(pad->poll_interval_us, interval);
+
+	return count;
+}
+
+static DEVICE_ATTR_RW(poll_interval_us);
+
+static ssize_t pressure_show(struct device *dev,
+			     struct device_attribute *attr, char *buf)
+{
+	struct psxpad *pad = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%d\n", READ_ONCE(pad->pressure));
+}
+
+/* takes effect through a reconfig, the poll length follows the mode ID */
+static ssize_t pressure_store(struct device *dev,
+			      struct device_attribute *attr,
+			      const char *buf, size_t count)
+{
+	struct psxpad *pad = dev_get_drvdata(dev);
+	bool pressure;
+	int err;
+
+	err = kstrtobool(buf, &pressure);
+	if (err)
+		return err;
+
+	if (pressure != READ_ONCE(pad->pressure)) {
+		WRITE_ONCE(pad->pressure, pressure);
+		WRITE_ONCE(pad->configured, false);
+	}
+
+	return count;
+}
+
+static DEVICE_ATTR_RW(pressure);
+
+static ssize_t idle_timeout_ms_show(struct device *dev,
+				    struct device_attribute *attr, char *buf)
+{
+	struct psxpad *pad = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", READ_ONCE(pad->idle_timeout_ms));
+}
+
+/* 0 keeps polling at the full rate */
+static ssize_t idle_timeout_ms_store(struct device *dev,
+				     struct device_attribute *attr,
+				     const char *buf, size_t count)
+{
+	struct psxpad *pad = dev_get_drvdata(dev);
+	u32 timeout;
+	int err;
+
+	err = kstrtou32(buf, 0, &timeout);
+	if (err)
+		return err;
+
+	WRITE_ONCE(pad->idle_timeout_ms, timeout);
+
+	return count;
+}
+
+static DEVICE_ATTR_RW(idle_timeout_ms);
+
+static struct attribute *psxpad_spi_attrs[] = {
+	&dev_attr_poll_interval_us.attr,
+	&dev_attr_pressure.attr,
+	&dev_attr_idle_timeout_ms.attr,
+	NULL
+};
+
+static const struct attribute_group psxpad_spi_attr_group = {
+	.attrs = psxpad_spi_attrs,
+};
+
+#define PSXPAD_STAT_ATTR(_name)						\
+static ssize_t _name##_show(struct device *dev,				\
+			    struct device_attribute *attr, char *buf)	\
+{									\
+	struct psxpad *pad = dev_get_drvdata(dev);			\
+									\
+	return sprintf(buf, "%lu\n", READ_ONCE(pad->stats._name));	\
+}									\
+static DEVICE_ATTR_RO(_name)
+
+PSXPAD_STAT_ATTR(good_frames);
+PSXPAD_STAT_ATTR(bad_frames);
+PSXPAD_STAT_ATTR(retries);
+PSXPAD_STAT_ATTR(disconnects);
+
+static struct attribute *psxpad_spi_stats_attrs[] = {
+	&dev_attr_good_frames.attr,
+	&dev_attr_bad_frames.attr,
+	&dev_attr_retries.attr,
+	&dev_attr_disconnects.attr,
+	NULL
+};
+
+static const struct attribute_group psxpad_spi_stats_group = {
+	.name = "stats",
+	.attrs = psxpad_spi_stats_attrs,
+};
+
+/* reading sums a snapshot over all CPUs, writing anything resets it */
+static int psxpad_latency_show(struct seq_file *m, void *v)
+{
+	struct psxpad *pad = m->private;
+	struct psxpad_hist *hist;
+	u64 sum;
+	int lat, bucket, cpu;
+
+	seq_puts(m, "us");
+	for (bucket = 0; bucket < PSXPAD_HIST_BUCKETS; bucket++)
+		seq_printf(m, " %llu", bucket ? 1ULL << (bucket - 1) : 0);
+	seq_putc(m, '\n');
+
+	for (lat = 0; lat < PSXPAD_LAT_NUM; lat++) {
+		seq_puts(m, psxpad_lat_names[lat]);
+		for (bucket = 0; bucket < PSXPAD_HIST_BUCKETS; bucket++) {
+			sum = 0;
+			for_each_possible_cpu(cpu) {
+				hist = per_cpu_ptr(pad->hist, cpu);
+				sum += READ_ONCE(hist->count[lat][bucket]);
+			}
+			seq_printf(m, " %llu", sum);
+		}
+		seq_putc(m, '\n');
+	}
+
+	return 0;
+}
+
+static int psxpad_latency_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, psxpad_latency_show, inode->i_private);
+}
+
+static ssize_t psxpad_latency_write(struct file *file, const char __user *buf,
+				    size_t count, loff_t *ppos)
+{
+	struct psxpad *pad = ((struct seq_file *)file->private_data)->private;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(pad->hist, cpu), 0,
+		       sizeof(struct psxpad_hist));
+
+	return count;
+}
+
+static const struct file_operations psxpad_latency_fops = {
+	.owner		= THIS_MODULE,
+	.open		= psxpad_latency_open,
+	.read		= seq_read,
+	.write		= psxpad_latency_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+/* one reader at a time, it gets the header and then every record */
+static int psxpad_trace_open(struct inode *inode, struct file *file)
+{
+	struct psxpad *pad = inode->i_private;
+	struct psxpad_trace *trace = &pad->trace;
+	u8 header[PSXPAD_TRACE_HEADER_LEN] = { 'P', 'S', 'X', 'T', 1, 1 };
+	u64 start;
+	int i, err;
+
+	if (test_and_set_bit(PSXPAD_TRACING, &pad->flags))
+		return -EBUSY;
+
+	err = kfifo_alloc(&trace->fifo, PSXPAD_TRACE_FIFO, GFP_KERNEL);
+	if (err) {
+		clear_bit(PSXPAD_TRACING, &pad->flags);
+		return err;
+	}
+
+	start = ktime_get_ns();
+	for (i = 0; i < 8; i++)
+		header[8 + i] = start >> (i * 8);
+	kfifo_in(&trace->fifo, header, sizeof(header));
+
+	spin_lock_irq(&trace->lock);
+	trace->start = start;
+	trace->last = start;
+	trace->run = 0;
+	trace->len = 0;
+	trace->resync = false;
+	memset(trace->frame, 0, sizeof(trace->frame));
+	trace->on = true;
+	spin_unlock_irq(&trace->lock);
+
+	file->private_data = pad;
+	return nonseekable_open(inode, file);
+}
+
+static ssize_t psxpad_trace_read(struct file *file, char __user *buf,
+				 size_t count, loff_t *ppos)
+{
+	struct psxpad *pad = file->private_data;
+	struct psxpad_trace *trace = &pad->trace;
+	unsigned int copied;
+	int err;
+
+	if (kfifo_is_empty(&trace->fifo)) {
+		if (file->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		err = wait_event_interruptible(trace->wait,
+					       !kfifo_is_empty(&trace->fifo));
+		if (err)
+			return err;
+	}
+
+	mutex_lock(&trace->read_lock);
+	err = kfifo_to_user(&trace->fifo, buf, count, &copied);
+	mutex_unlock(&trace->read_lock);
+
+	return err ? err : copied;
+}
+
+static __poll_t psxpad_trace_poll(struct file *file, poll_table *wait)
+{
+	struct psxpad *pad = file->private_data;
+	struct psxpad_trace *trace = &pad->trace;
+
+	poll_wait(file, &trace->wait, wait);
+
+	return kfifo_is_empty(&trace->fifo) ? 0 : EPOLLIN | EPOLLRDNORM;
+}
+
+static int psxpad_trace_release(struct inode *inode, struct file *file)
+{
+	struct psxpad *pad = file->private_data;
+	struct psxpad_trace *trace = &pad->trace;
+
+	spin_lock_irq(&trace->lock);
+	trace->on = false;
+	spin_unlock_irq(&trace->lock);
+
+	kfifo_free(&trace->fifo);
+	clear_bit(PSXPAD_TRACING, &pad->flags);
+
+	return 0;
+}
+
+static const struct file_operations psxpad_trace_fops = {
+	.owner		= THIS_MODULE,
+	.open		= psxpad_trace_open,
+	.read		= psxpad_trace_read,
+	.poll		= psxpad_trace_poll,
+	.release	= psxpad_trace_release,
+};
+
+static void psxpad_debugfs_remove(void *data)
+{
+	struct psxpad *pad = data;
+
+	debugfs_remove_recursive(pad->debugfs);
+}
+
+static void psxpad_pm_disable(void *data)
+{
+	struct device *dev = data;
+
+	pm_runtime_disable(dev);
+	pm_runtime_dont_use_autosuspend(dev);
+}
+
+static int psxpad_spi_probe(struct spi_device *spi)
+{
+	struct psxpad *pad;
+	struct input_dev *idev;
+	int i, err;
+
+	pad = devm_kzalloc(&spi->dev, sizeof(struct psxpad), GFP_KERNEL);
+	if (!pad)
+		return -ENOMEM;
+
+	pad->hist = devm_alloc_percpu(&spi->dev, struct psxpad_hist);
+	if (!pad->hist)
+		return -ENOMEM;
+
+	pad->bus = psxpad_bus_get(spi->controller);
+	if (!pad->bus)
+		return -ENOMEM;
+
+	err = devm_add_action_or_reset(&spi->dev, psxpad_bus_put, pad->bus);
+	if (err)
+		return err;
+
+	idev = devm_input_allocate_device(&spi->dev);
+	if (!idev) {
+		dev_err(&spi->dev, "failed to allocate input device\n");
+		return -ENOMEM;
+	}
+
+	pad->idev = idev;
+	pad->spi = spi;
+	pad->polllen = sizeof(PSX_CMD_POLL);
+	spi_set_drvdata(spi, pad);
+	input_set_drvdata(idev, pad);
+	INIT_LIST_HEAD(&pad->bus_node);
+	INIT_DELAYED_WORK(&pad->poll_work, psxpad_poll_work);
+	INIT_WORK(&pad->config_work, psxpad_config_work);
+	spin_lock_init(&pad->report_lock);
+	spin_lock_init(&pad->trace.lock);
+	mutex_init(&pad->trace.read_lock);
+	init_waitqueue_head(&pad->trace.wait);
+
+	/* a nonzero interval selects the hrtimer engine */
+	device_property_read_u32(&spi->dev, "poll-interval-us",
+				 &pad->poll_interval_us);
+	if (pad->poll_interval_us)
+		pad->poll_interval_us = clamp_t(u32, pad->poll_interval_us,
+						PSXPAD_POLL_INTERVAL_US_MIN,
+						PSXPAD_POLL_INTERVAL_US_MAX);
+
+	pad->idle_timeout_ms = PSXPAD_IDLE_TIMEOUT_MS;
+	device_property_read_u32(&spi->dev, "idle-timeout-ms",
+				 &pad->idle_timeout_ms);
+
+	/* input device settings */
+	idev->name = "PlayStation 1/2 joypad";
+	snprintf(pad->phys, sizeof(pad->phys), "%s/input", dev_name(&spi->dev));
+	idev->phys = pad->phys;
+	idev->id.bustype = BUS_SPI;
+	idev->open = psxpad_spi_open;
+	idev->close = psxpad_spi_close;
+	pad->tap_input[0] = idev;
+
+	/* key/value map settings */
+	psxpad_set_capabilities(idev);
+	/* a multitap slot is too short for pressure, only port A has them */
+	for (i = 0; i < ARRAY_SIZE(psxpad_pressure_axes); i++)
+		input_set_abs_params(idev, psxpad_pressure_axes[i],
+				     0, 255, 0, 0);
+	pad->pressure = device_property_read_bool(&spi->dev,
+						  "pressure-buttons");
+
+	err = psxpad_spi_init_ff(pad);
+	if (err)
+		return err;
+
+	/* optional ACK line, lets the clock be stepped up safely */
+	pad->ack_gpio = devm_gpiod_get_optional(&spi->dev, "ack", GPIOD_IN);
+	if (IS_ERR(pad->ack_gpio))
+		return PTR_ERR(pad->ack_gpio);
+
+	if (pad->ack_gpio) {
+		err = devm_request_irq(&spi->dev, gpiod_to_irq(pad->ack_gpio),
+				       psxpad_ack_irq, IRQF_TRIGGER_FALLING,
+				       "psxpad-ack", pad);
+		if (err) {
+			dev_err(&spi->dev, "failed to request ACK irq: %d\n",
+				err);
+			return err;
+		}
+	}
+
+	/* SPI settings */
+	spi->mode = SPI_MODE_3;
+	/* let the controller shift LSB first, else bits are swapped in SW */
+	pad->lsb_first = spi->controller->mode_bits & SPI_LSB_FIRST;
+	if (pad->lsb_first)
+		spi->mode |= SPI_LSB_FIRST;
+	spi->bits_per_word = 8;
+	/*
+	 * Without ACK the pad stays at 125kHz. With ACK the clock is
+	 * negotiated per transfer up to spi-max-frequency, at most 1MHz.
+	 */
+	if (!pad->ack_gpio || !spi->max_speed_hz)
+		spi->max_speed_hz = psxpad_speeds[0];
+	spi->max_speed_hz = clamp_t(u32, spi->max_speed_hz, psxpad_speeds[0],
+				    psxpad_speeds[PSXPAD_SPEED_LAST]);
+	err = spi_setup(spi);
+	if (err) {
+		dev_err(&spi->dev, "failed to set up SPI: %d\n", err);
+		return err;
+	}
+
+	/* poll frames are kept in wire order */
+	psxpad_init_frames(pad);
+
+	/* pad settings */
+	psxpad_set_motor_level(pad, 0, 0);
+	psxpad_control_motor(pad, true, true);
+
+	err = devm_device_add_group(&spi->dev, &psxpad_spi_attr_group);
+	if (err) {
+		dev_err(&spi->dev, "failed to create sysfs group: %d\n", err);
+		return err;
+	}
+
+	err = devm_device_add_group(&spi->dev, &psxpad_spi_stats_group);
+	if (err) {
+		dev_err(&spi->dev, "failed to create sysfs group: %d\n", err);
+		return err;
+	}
+
+	pad->debugfs = debugfs_create_dir(dev_name(&spi->dev),
+					  psxpad_debugfs_root);
+	debugfs_create_file("latency", 0600, pad->debugfs, pad,
+			    &psxpad_latency_fops);
+	debugfs_create_file("trace", 0400, pad->debugfs, pad,
+			    &psxpad_trace_fops);
+	err = devm_add_action_or_reset(&spi->dev, psxpad_debugfs_remove, pad);
+	if (err)
+		return err;
+
+	/* runtime PM is up before open can be called */
+	pm_runtime_set_autosuspend_delay(&spi->dev, PSXPAD_AUTOSUSPEND_MS);
+	pm_runtime_use_autosuspend(&spi->dev);
+	pm_runtime_enable(&spi->dev);
+	err = devm_add_action_or_reset(&spi->dev, psxpad_pm_disable, &spi->dev);
+	if (err)
+		return err;
+
+	/* register input device */
+	err = input_register_device(idev);
+	if (err) {
+		dev_err(&spi->dev,
+			"failed to register input device: %d\n", err);
+		return err;
+	}
+
+	return 0;
+}
+
+/* one poll frame with both motors off, polling waits while it is sent */
+static void psxpad_motor_off(struct psxpad *pad)
+{
+	u8 len = min_t(u8, pad->polllen, sizeof(PSX_CMD_POLL));
+
+	wait_var_event(&pad->flags,
+		       !test_and_set_bit_lock(PSXPAD_POLL_BUSY, &pad->flags));
+
+	psxpad_set_motor_level(pad, 0, 0);
+	memcpy(pad->sendbuf, PSX_CMD_POLL, len);
+	psxpad_command(pad, len);
+
+	psxpad_poll_done(pad);
+}
+
+static int __maybe_unused psxpad_spi_suspend(struct device *dev)
+{
+	struct spi_device *spi = to_spi_device(dev);
+	struct psxpad *pad = spi_get_drvdata(spi);
+
+	set_bit(PSXPAD_SUSPENDED, &pad->flags);
+	psxpad_motor_off(pad);
+
+	return 0;
+}
+
+static int __maybe_unused psxpad_spi_resume(struct device *dev)
+{
+	struct spi_device *spi = to_spi_device(dev);
+	struct psxpad *pad = spi_get_drvdata(spi);
+
+	/* the pad may have lost power, the first poll sends config again */
+	pad->configured = false;
+	clear_bit(PSXPAD_SUSPENDED, &pad->flags);
+
+	return 0;
+}
+
+/* polling has stopped or backed off, only a running motor is left */
+static int __maybe_unused psxpad_spi_runtime_suspend(struct device *dev)
+{
+	struct spi_device *spi = to_spi_device(dev);
+	struct psxpad *pad = spi_get_drvdata(spi);
+
+	if (pad->motor1level || pad->motor2level)
+		psxpad_motor_off(pad);
+
+	return 0;
+}
+
+static const struct dev_pm_ops psxpad_spi_pm = {
+	SET_SYSTEM_SLEEP_PM_OPS(psxpad_spi_suspend, psxpad_spi_resume)
+	SET_RUNTIME_PM_OPS(psxpad_spi_runtime_suspend, NULL, NULL)
+};
+
+static const struct spi_device_id psxpad_spi_id[] = {
+	{ "psxpad-spi", 0 },
+	{ }
+};
+MODULE_DEVICE_TABLE(spi, psxpad_spi_id);
 
 static struct spi_driver psxpad_spi_driver = {
 	.driver = {
@@ -394,7 +2096,26 @@ static struct spi_driver psxpad_spi_driver = {
 	.probe   = psxpad_spi_probe,
 };
 
-module_spi_driver(psxpad_spi_driver);
+static int __init psxpad_spi_init(void)
+{
+	int err;
+
+	psxpad_debugfs_root = debugfs_create_dir("psxpad-spi", NULL);
+
+	err = spi_register_driver(&psxpad_spi_driver);
+	if (err)
+		debugfs_remove_recursive(psxpad_debugfs_root);
+
+	return err;
+}
+module_init(psxpad_spi_init);
+
+static void __exit psxpad_spi_exit(void)
+{
+	spi_unregister_driver(&psxpad_spi_driver);
+	debugfs_remove_recursive(psxpad_debugfs_root);
+}
+module_exit(psxpad_spi_exit);
 
 MODULE_AUTHOR("Tomohiro Yoshidomi <sylph23k@gmail.com>");
 MODULE_DESCRIPTION("PlayStation 1/2 joypads via SPI interface Driver");
@@ -1,5 +1,5 @@
 /*
- * PSX(Play Station 1/2) pad testing utility (using spidev driver)
+ * PSX(Play Station 1/2) pad uinput bridge (using spidev driver)
  *
  * Copyright (c) 2017 AZO
  *
@@ -8,102 +8,65 @@
  * the Free Software Foundation; either version 2 of the License.
  */
 
+#define _GNU_SOURCE
 #include <stdint.h>
-#include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <getopt.h>
 #include <fcntl.h>
+#include <signal.h>
+#include <sched.h>
+#include <errno.h>
+#include <poll.h>
 #include <sys/ioctl.h>
-#include <linux/types.h>
-#include <linux/spi/spidev.h>
-
-#define PSXPAD_MAXPADNUM 2
-#if PSXPAD_MAXPADNUM == 0 || PSXPAD_MAXPADNUM > 2
-#error PSXPAD_MAXPADNUM must be 1-2
-#endif
-
-enum {
-	PSXPAD_KEYSTATE_TYPE_DIGITAL = 0,
-	PSXPAD_KEYSTATE_TYPE_ANALOG1,
-	PSXPAD_KEYSTATE_TYPE_ANALOG2,
-	PSXPAD_KEYSTATE_TYPE_UNKNOWN
-};
+#include <sys/mman.h>
+#include <linux/input.h>
+#include <linux/uinput.h>
 
-struct PSXPad_KeyState {
-	int vType;
-	/* PSXPAD_KEYSTATE_DIGITAL */
-	uint8_t bSel;
-	uint8_t bStt;
-	uint8_t bU;
-	uint8_t bR;
-	uint8_t bD;
-	uint8_t bL;
-	uint8_t bL2;
-	uint8_t bR2;
-	uint8_t bL1;
-	uint8_t bR1;
-	uint8_t bTri;
-	uint8_t bCir;
-	uint8_t bCrs;
-	uint8_t bSqr;
-	/* PSXPAD_KEYSTATE_ANALOG1 */
-	uint8_t bL3;
-	uint8_t bR3;
-	uint8_t u8RX;
-	uint8_t u8RY;
-	uint8_t u8LX;
-	uint8_t u8LY;
-	/* PSXPAD_KEYSTATE_ANALOG2 */
-	uint8_t u8AR;
-	uint8_t u8AL;
-	uint8_t u8AU;
-	uint8_t u8AD;
-	uint8_t u8ATri;
-	uint8_t u8ACir;
-	uint8_t u8ACrs;
-	uint8_t u8ASqr;
-	uint8_t u8AL1;
-	uint8_t u8AR1;
-	uint8_t u8AL2;
-	uint8_t u8AR2;
-};
+#include "libpsxpad.h"
+#include "libpsxpad_gpio.h"
+#include "libpsxpad_shm.h"
 
 static const char device[] = "/dev/spidev0.0";
 
-const uint8_t PSX_CMD_INIT_PRESSURE[]	= {0x01, 0x40, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00};
-const uint8_t PSX_CMD_POLL[]		= {0x01, 0x42, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
-const uint8_t PSX_CMD_ENTER_CFG[]	= {0x01, 0x43, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00};
-const uint8_t PSX_CMD_EXIT_CFG[]	= {0x01, 0x43, 0x00, 0x00, 0x5A, 0x5A, 0x5A, 0x5A, 0x5A};
-const uint8_t PSX_CMD_ENABLE_MOTOR[]	= {0x01, 0x4D, 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
-const uint8_t PSX_CMD_ALL_PRESSURE[]	= {0x01, 0x4F, 0x00, 0xFF, 0xFF, 0x03, 0x00, 0x00, 0x00};
-const uint8_t PSX_CMD_AD_MODE[]		= {0x01, 0x44, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00};
-
-struct PSXPad {
-	uint8_t lu8PoolCmd[sizeof(PSX_CMD_POLL)];
-	uint8_t lu8Response[sizeof(PSX_CMD_POLL)];
-	uint8_t u8AttPinNo;
-	uint8_t bAnalog;
-	uint8_t bLock;
-	uint8_t bMotor1Enable;
-	uint8_t bMotor2Enable;
-	uint8_t u8Motor1Level;
-	uint8_t u8Motor2Level;
-	uint8_t lu8EnableMotor[sizeof(PSX_CMD_ENABLE_MOTOR)];
-	uint8_t lu8ADMode[sizeof(PSX_CMD_AD_MODE)];
+/* same key and axis map as psxpad-spi.c, in the order of the packed state */
+static const uint16_t lu16PSXPadButton[16] = {
+	BTN_SELECT, BTN_THUMBL, BTN_THUMBR, BTN_START,
+	BTN_DPAD_UP, BTN_DPAD_RIGHT, BTN_DPAD_DOWN, BTN_DPAD_LEFT,
+	BTN_TL2, BTN_TR2, BTN_TL, BTN_TR,
+	BTN_X, BTN_A, BTN_B, BTN_Y
 };
 
-struct PSXPads {
-	int iFD;
-	struct spi_ioc_transfer tTransfer;
-	uint8_t u8PadsNum;
-	struct PSXPad ltPad[PSXPAD_MAXPADNUM];
+static const uint16_t lu16PSXPadAxis[4] = {
+	ABS_RX, ABS_RY, ABS_X, ABS_Y
 };
 
-static struct PSXPads tPSXPads;
-static struct PSXPad_KeyState tPSXKeyState;
+/* as there, only the first port of a pad has them */
+static const uint16_t lu16PSXPadPressure[12] = {
+	ABS_MISC, ABS_MISC + 1, ABS_MISC + 2, ABS_MISC + 3,
+	ABS_MISC + 4, ABS_MISC + 5, ABS_BRAKE, ABS_GAS,
+	ABS_THROTTLE, ABS_RUDDER, ABS_Z, ABS_RZ
+};
 
-#define REVERSE_BIT(x) ((((x) & 0x80) >> 7) | (((x) & 0x40) >> 5) | (((x) & 0x20) >> 3) | (((x) & 0x10) >> 1) | (((x) & 0x08) << 1) | (((x) & 0x04) << 3) | (((x) & 0x02) << 5) | (((x) & 0x01) << 7))
+/* one uinput device per pad, or per port behind a multitap */
+struct PSXPad_UInput {
+	int iFD;
+	uint8_t bPressure;
+	uint8_t bPresent;
+	struct PSXPad_PackedState tLast;
+};
+
+static struct PSXPads *ptPSXPads;
+static struct PSXPadShm *ptShm;
+static struct PSXPad_UInput ltUInput[PSXPAD_MAXPADNUM][PSXPAD_TAP_PORTS];
+static uint8_t bVerbose;
+static uint8_t bReplay;
+static uint8_t bPressure;
+/* bit per pad whose mode is set once the callbacks of a poll are done */
+static uint8_t u8ConfigPads;
+static volatile sig_atomic_t bStop;
 
 static void pabort(const char s[])
 {
@@ -111,301 +74,441 @@ static void pabort(const char s[])
 	abort();
 }
 
-int spi0_init(int i_iFD, struct spi_ioc_transfer *o_ptTransfer, const uint8_t i_u8Mode, const uint8_t i_u8Bits, const uint32_t i_u32Speed, const uint16_t i_u16Delay)
+static void sigstop(int i_iSignal)
 {
-	int ret = 0;
+	bStop = 1;
+	PSXPads_Stop(ptPSXPads);
+}
 
-	if (!o_ptTransfer)
+static int PSXPad_UInputAbs(const int i_iFD, const uint16_t i_u16Code, const uint8_t i_u8Value)
+{
+	struct uinput_abs_setup tAbs;
+
+	memset(&tAbs, 0, sizeof(tAbs));
+	tAbs.code = i_u16Code;
+	tAbs.absinfo.value = i_u8Value;
+	tAbs.absinfo.minimum = 0;
+	tAbs.absinfo.maximum = 255;
+	if (ioctl(i_iFD, UI_SET_ABSBIT, i_u16Code) < 0)
 		return -1;
 
-	/*
-	 * spi mode
-	 */
-	ret = ioctl(i_iFD, SPI_IOC_WR_MODE, &i_u8Mode);
-	if (ret == -1)
-		pabort("can't set write spi mode");
-	ret = ioctl(i_iFD, SPI_IOC_RD_MODE, &i_u8Mode);
-	if (ret == -1)
-		pabort("can't get read spi mode");
-
-	/*
-	 * bits per word
-	 */
-	ret = ioctl(i_iFD, SPI_IOC_WR_BITS_PER_WORD, &i_u8Bits);
-	if (ret == -1)
-		pabort("can't set write bits per word");
-	ret = ioctl(i_iFD, SPI_IOC_RD_BITS_PER_WORD, &i_u8Bits);
-	if (ret == -1)
-		pabort("can't get read bits per word");
+	return ioctl(i_iFD, UI_ABS_SETUP, &tAbs);
+}
 
-	/*
-	 * max speed hz
-	 */
-	ret = ioctl(i_iFD, SPI_IOC_WR_MAX_SPEED_HZ, &i_u32Speed);
-	if (ret == -1)
-		pabort("can't set write max speed hz");
-	ret = ioctl(i_iFD, SPI_IOC_RD_MAX_SPEED_HZ, &i_u32Speed);
-	if (ret == -1)
-		pabort("can't get read max speed hz");
-
-	printf("spi mode: %d\n", i_u8Mode);
-	printf("bits per word: %d\n", i_u8Bits);
-	printf("max speed: %d Hz (%d KHz)\n", i_u32Speed, i_u32Speed/1000);
-
-	/* set transfer settings */
-	o_ptTransfer->delay_usecs = i_u16Delay;
-	o_ptTransfer->speed_hz = i_u32Speed;
-	o_ptTransfer->bits_per_word = i_u8Bits;
+static int PSXPad_UInputOpen(struct PSXPad_UInput *ptUInput, const char i_strName[], const uint8_t i_bPressure)
+{
+	struct uinput_setup tSetup;
+	int i;
 
-	return ret;
+	ptUInput->iFD = open("/dev/uinput", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+	if (ptUInput->iFD < 0)
+		return -1;
+	ptUInput->bPressure = i_bPressure;
+
+	/* sticks start centered, like the decoder reports a pad without them */
+	memset(&(ptUInput->tLast), 0, sizeof(ptUInput->tLast));
+	memset(ptUInput->tLast.lu8Axis, 0x80, sizeof(ptUInput->tLast.lu8Axis));
+
+	if (ioctl(ptUInput->iFD, UI_SET_EVBIT, EV_KEY) < 0 || ioctl(ptUInput->iFD, UI_SET_EVBIT, EV_ABS) < 0)
+		goto err;
+	for (i = 0; i < 16; i++)
+		if (ioctl(ptUInput->iFD, UI_SET_KEYBIT, lu16PSXPadButton[i]) < 0)
+			goto err;
+	for (i = 0; i < 4; i++)
+		if (PSXPad_UInputAbs(ptUInput->iFD, lu16PSXPadAxis[i], ptUInput->tLast.lu8Axis[i]) < 0)
+			goto err;
+	for (i = 0; i < 12 && ptUInput->bPressure; i++)
+		if (PSXPad_UInputAbs(ptUInput->iFD, lu16PSXPadPressure[i], 0) < 0)
+			goto err;
+
+	memset(&tSetup, 0, sizeof(tSetup));
+	tSetup.id.bustype = BUS_SPI;
+	strncpy(tSetup.name, i_strName, sizeof(tSetup.name) - 1);
+	if (ioctl(ptUInput->iFD, UI_DEV_SETUP, &tSetup) < 0 || ioctl(ptUInput->iFD, UI_DEV_CREATE) < 0)
+		goto err;
+
+	return 0;
+
+err:
+	close(ptUInput->iFD);
+	ptUInput->iFD = -1;
+	return -1;
 }
 
-void PSXPads_Init(struct PSXPads *ptPSXPads, const char i_strDevice[], const uint8_t i_u8PadNum)
+static void PSXPad_UInputClose(struct PSXPad_UInput *ptUInput)
 {
-	uint8_t u8PadNo, u8Loc;
-
-	if (!ptPSXPads)
-		return;
-	if (!i_strDevice)
+	if (ptUInput->iFD < 0)
 		return;
-	if (i_u8PadNum == 0 || i_u8PadNum >= PSXPAD_MAXPADNUM)
-		return;
-
-	ptPSXPads->iFD = open(i_strDevice, O_RDWR);
-	if (ptPSXPads->iFD < 0)
-		pabort("can't open device");
-
-	/* mode 3, 125kbps */
-	if (spi0_init(ptPSXPads->iFD, &(ptPSXPads->tTransfer), SPI_MODE_3, 8, 125000, 100) < 0)
-		pabort("can't init SPI");
 
-	ptPSXPads->u8PadsNum = i_u8PadNum;
-
-	for (u8PadNo = 0; u8PadNo < ptPSXPads->u8PadsNum; u8PadNo++) {
-		for (u8Loc = 0; u8Loc < sizeof(PSX_CMD_POLL); u8Loc++)
-			ptPSXPads->ltPad[u8PadNo].lu8PoolCmd[u8Loc] = PSX_CMD_POLL[u8Loc];
-		for (u8Loc = 0; u8Loc < sizeof(PSX_CMD_ENABLE_MOTOR); u8Loc++)
-			ptPSXPads->ltPad[u8PadNo].lu8EnableMotor[u8Loc] = PSX_CMD_ENABLE_MOTOR[u8Loc];
-		for (u8Loc = 0; u8Loc < sizeof(PSX_CMD_AD_MODE); u8Loc++)
-			ptPSXPads->ltPad[u8PadNo].lu8ADMode[u8Loc] = PSX_CMD_AD_MODE[u8Loc];
-	}
+	ioctl(ptUInput->iFD, UI_DEV_DESTROY);
+	close(ptUInput->iFD);
+	ptUInput->iFD = -1;
 }
 
-void PSXPads_Uninit(struct PSXPads *ptPSXPads)
+static inline void PSXPad_Event(struct input_event *o_ptEvent, const uint16_t i_u16Type, const uint16_t i_u16Code, const int32_t i_i32Value)
 {
-	if (!ptPSXPads)
-		return;
-
-	close(ptPSXPads->iFD);
+	o_ptEvent->type = i_u16Type;
+	o_ptEvent->code = i_u16Code;
+	o_ptEvent->value = i_i32Value;
 }
 
-void PSXPads_Command(struct PSXPads *ptPSXPads, const uint8_t u8PadNo, const uint8_t i_lu8SendCmd[], uint8_t o_lu8Response[], const uint8_t i_u8SendCmdLen)
+/* what changed since the last frame and a SYN_REPORT, in one write() */
+static void changed(struct PSXPads *ptPSXPads, const uint8_t u8PadNo, const uint8_t u8Port, const struct PSXPad_PackedState *ptState, void *pvUser)
 {
-	int ret;
-	uint8_t u8Loc;
-	uint8_t u8SendBuf[0x100];
+	struct PSXPad_UInput *ptUInput = &ltUInput[u8PadNo][u8Port];
+	struct input_event ltEvent[16 + 4 + 12 + 1];
+	const uint8_t *pu8Frame;
+	uint16_t u16Changed;
+	uint8_t u8Num = 0, u8Len;
+	int i;
+
+	if (bVerbose) {
+		pu8Frame = PSXPads_GetFrame(ptPSXPads, u8PadNo, &u8Len);
+		printf("%d%c: ", u8PadNo, 'A' + u8Port);
+		for (i = 0; i < u8Len; i++)
+			printf("%02X ", pu8Frame[i]);
+		printf("\n");
+	}
 
-	if (!ptPSXPads)
-		return;
-	if (u8PadNo >= ptPSXPads->u8PadsNum)
-		return;
-	if (!i_lu8SendCmd)
-		return;
-	if (!o_lu8Response)
+	/* other processes get every frame, the unplugged state included */
+	if (ptShm && PSXPadShm_Publish(ptShm, u8PadNo, u8Port, ptState, NULL) < 0)
+		perror("can't publish pad state");
+
+	/* a trace tells whether there was a multitap only by its frames */
+	if (bReplay && ptUInput->iFD < 0 && ptState->u8Type != PSXPAD_KEYSTATE_TYPE_UNKNOWN) {
+		pu8Frame = PSXPads_GetFrame(ptPSXPads, u8PadNo, NULL);
+		if (PSXPad_UInputOpen(ptUInput, pu8Frame[1] == 0x80 ? "PlayStation 1/2 joypad (multitap)" : "PlayStation 1/2 joypad", bPressure && u8Port == 0) < 0)
+			pabort("can't create uinput device");
+	}
+
+	/* an unplugged pad keeps its last state, as with psxpad-spi */
+	if (ptUInput->iFD < 0)
 		return;
-	if (i_u8SendCmdLen == 0)
+	if (ptState->u8Type == PSXPAD_KEYSTATE_TYPE_UNKNOWN) {
+		ptUInput->bPresent = 0;
 		return;
+	}
 
-	for (u8Loc = 0; u8Loc < i_u8SendCmdLen; u8Loc++)
-		u8SendBuf[u8Loc] = REVERSE_BIT(i_lu8SendCmd[u8Loc]);
+	/*
+	 * a pad forgets its mode when unplugged, it is set after its first frame;
+	 * not from here, the other ports of this poll are still being reported
+	 */
+	if (!ptUInput->bPresent && u8Port == 0 && !bReplay)
+		u8ConfigPads |= 1 << u8PadNo;
+	ptUInput->bPresent = 1;
 
-	/* set transfer settings */
-	ptPSXPads->tTransfer.tx_buf	= (unsigned long)u8SendBuf;
-	ptPSXPads->tTransfer.rx_buf	= (unsigned long)o_lu8Response;
-	ptPSXPads->tTransfer.len	= i_u8SendCmdLen;
-	ptPSXPads->tTransfer.cs_change	= u8PadNo;
+	if (PSXPad_PackedEqual(&(ptUInput->tLast), ptState))
+		return;
 
-	ret = ioctl(ptPSXPads->iFD, SPI_IOC_MESSAGE(1), &(ptPSXPads->tTransfer));
-	if (ret < 1)
-		pabort("can't send spi message");
+	memset(ltEvent, 0, sizeof(ltEvent));
+	u16Changed = PSXPad_Pressed(&(ptUInput->tLast), ptState) | PSXPad_Released(&(ptUInput->tLast), ptState);
+	for (i = 0; i < 16; i++)
+		if (u16Changed & (1 << i))
+			PSXPad_Event(&ltEvent[u8Num++], EV_KEY, lu16PSXPadButton[i], (ptState->u16Buttons >> i) & 1);
+	for (i = 0; i < 4; i++)
+		if (ptState->lu8Axis[i] != ptUInput->tLast.lu8Axis[i])
+			PSXPad_Event(&ltEvent[u8Num++], EV_ABS, lu16PSXPadAxis[i], ptState->lu8Axis[i]);
+	for (i = 0; i < 12 && ptUInput->bPressure; i++)
+		if (ptState->lu8Pressure[i] != ptUInput->tLast.lu8Pressure[i])
+			PSXPad_Event(&ltEvent[u8Num++], EV_ABS, lu16PSXPadPressure[i], ptState->lu8Pressure[i]);
+	ptUInput->tLast = *ptState;
+	if (u8Num == 0)
+		return;
+	PSXPad_Event(&ltEvent[u8Num++], EV_SYN, SYN_REPORT, 0);
 
-	for (u8Loc = 0; u8Loc < i_u8SendCmdLen; u8Loc++)
-		o_lu8Response[u8Loc] = REVERSE_BIT(o_lu8Response[u8Loc]);
+	if (write(ptUInput->iFD, ltEvent, u8Num * sizeof(ltEvent[0])) < 0)
+		perror("can't write uinput events");
 }
 
-void PSXPads_Pool(struct PSXPads *ptPSXPads)
+/* PSXPads_Run(), with the mode of pads plugged in set between polls */
+static int PSXPad_Run(void)
 {
+	struct pollfd tPollFD;
 	uint8_t u8PadNo;
 
-	if (!ptPSXPads)
-		return;
+	/* nothing is sent to a trace */
+	if (bReplay)
+		return PSXPads_Run(ptPSXPads);
+
+	tPollFD.fd = PSXPads_GetFD(ptPSXPads);
+	tPollFD.events = POLLIN;
+	while (!bStop) {
+		if (poll(&tPollFD, 1, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (PSXPads_Dispatch(ptPSXPads) < 0)
+			return -1;
+
+		for (u8PadNo = 0; u8ConfigPads; u8PadNo++) {
+			if (!(u8ConfigPads & (1 << u8PadNo)))
+				continue;
+			u8ConfigPads &= ~(1 << u8PadNo);
+			if (PSXPads_SetADMode(ptPSXPads, u8PadNo, 1, 1) < 0)
+				perror("can't set analog mode");
+			else if (bPressure && PSXPads_SetPressure(ptPSXPads, u8PadNo, 1) < 0)
+				perror("can't set pressure mode");
+		}
+	}
 
-	for (u8PadNo = 0; u8PadNo < ptPSXPads->u8PadsNum; u8PadNo++)
-		PSXPads_Command(ptPSXPads, u8PadNo, ptPSXPads->ltPad[u8PadNo].lu8PoolCmd, ptPSXPads->ltPad[u8PadNo].lu8Response, sizeof(PSX_CMD_POLL));
+	return 0;
 }
 
-void PSXPads_SetADMode(struct PSXPads *ptPSXPads, const uint8_t u8PadNo, const uint8_t i_bAnalog, const uint8_t i_bLock)
+/* "0,2-3" style CPU list */
+static int PSXPad_ParseCPUs(const char i_strCPUs[], cpu_set_t *o_ptCPUs)
 {
-	if (!ptPSXPads)
-		return;
-	if (u8PadNo >= ptPSXPads->u8PadsNum)
-		return;
-
-	ptPSXPads->ltPad[u8PadNo].bAnalog = i_bAnalog ? 1 : 0;
-	ptPSXPads->ltPad[u8PadNo].bLock   = i_bLock   ? 1 : 0;
-
-	ptPSXPads->ltPad[u8PadNo].lu8ADMode[3] = ptPSXPads->ltPad[u8PadNo].bAnalog ? 0x01 : 0x00;
-	ptPSXPads->ltPad[u8PadNo].lu8ADMode[4] = ptPSXPads->ltPad[u8PadNo].bLock   ? 0x03 : 0x00;
+	const char *pcPos = i_strCPUs;
+	char *pcEnd;
+	unsigned long ulFirst, ulLast;
+
+	CPU_ZERO(o_ptCPUs);
+	while (*pcPos) {
+		ulFirst = strtoul(pcPos, &pcEnd, 10);
+		if (pcEnd == pcPos)
+			return -1;
+		ulLast = ulFirst;
+		if (*pcEnd == '-') {
+			pcPos = pcEnd + 1;
+			ulLast = strtoul(pcPos, &pcEnd, 10);
+			if (pcEnd == pcPos || ulLast < ulFirst)
+				return -1;
+		}
+		if (ulLast >= CPU_SETSIZE)
+			return -1;
+		for (; ulFirst <= ulLast; ulFirst++)
+			CPU_SET(ulFirst, o_ptCPUs);
+
+		if (*pcEnd == ',')
+			pcEnd++;
+		else if (*pcEnd)
+			return -1;
+		pcPos = pcEnd;
+	}
 
-	PSXPads_Command(ptPSXPads, u8PadNo, PSX_CMD_ENTER_CFG, ptPSXPads->ltPad[u8PadNo].lu8Response, sizeof(PSX_CMD_ENTER_CFG));
-	PSXPads_Command(ptPSXPads, u8PadNo, ptPSXPads->ltPad[u8PadNo].lu8ADMode, ptPSXPads->ltPad[u8PadNo].lu8Response, sizeof(PSX_CMD_AD_MODE));
-	PSXPads_Command(ptPSXPads, u8PadNo, PSX_CMD_INIT_PRESSURE, ptPSXPads->ltPad[u8PadNo].lu8Response, sizeof(PSX_CMD_INIT_PRESSURE));
-	PSXPads_Command(ptPSXPads, u8PadNo, PSX_CMD_ALL_PRESSURE, ptPSXPads->ltPad[u8PadNo].lu8Response, sizeof(PSX_CMD_ALL_PRESSURE));
-	PSXPads_Command(ptPSXPads, u8PadNo, PSX_CMD_EXIT_CFG, ptPSXPads->ltPad[u8PadNo].lu8Response, sizeof(PSX_CMD_EXIT_CFG));
+	return 0;
 }
 
-void PSXPads_SetEnableMotor(struct PSXPads *ptPSXPads, const uint8_t u8PadNo, const uint8_t i_bMotor1Enable, const uint8_t i_bMotor2Enable)
+/* "/dev/gpiochip0:DAT,CMD,CLK,ACK,ATT[,ATT...]", ACK -1 without; the chip is cut off at the colon */
+static int PSXPad_ParseGPIO(char io_strGPIO[], struct PSXPadGPIO_Lines *o_ptLines, int *o_piPadsNum)
 {
-	if (!ptPSXPads)
-		return;
-	if (u8PadNo >= ptPSXPads->u8PadsNum)
-		return;
+	char *pcPos = strrchr(io_strGPIO, ':');
+	char *pcEnd;
+	long lOffset;
+	int iNum = 0;
 
-	ptPSXPads->ltPad[u8PadNo].bMotor1Enable = i_bMotor1Enable ? 1 : 0;
-	ptPSXPads->ltPad[u8PadNo].bMotor2Enable = i_bMotor2Enable ? 1 : 0;
-
-	ptPSXPads->ltPad[u8PadNo].lu8EnableMotor[3] = ptPSXPads->ltPad[u8PadNo].bMotor1Enable ? 0x00 : 0xFF;
-	ptPSXPads->ltPad[u8PadNo].lu8EnableMotor[4] = ptPSXPads->ltPad[u8PadNo].bMotor2Enable ? 0x01 : 0xFF;
+	if (!pcPos)
+		return -1;
+	*pcPos++ = '\0';
+
+	memset(o_ptLines, 0, sizeof(*o_ptLines));
+	while (*pcPos) {
+		lOffset = strtol(pcPos, &pcEnd, 10);
+		if (pcEnd == pcPos || (lOffset < 0 && iNum != 3) || iNum >= 4 + PSXPAD_MAXPADNUM)
+			return -1;
+		switch (iNum) {
+		case 0:
+			o_ptLines->u32Dat = lOffset;
+			break;
+		case 1:
+			o_ptLines->u32Cmd = lOffset;
+			break;
+		case 2:
+			o_ptLines->u32Clk = lOffset;
+			break;
+		case 3:
+			o_ptLines->i32Ack = (lOffset < 0) ? -1 : lOffset;
+			break;
+		default:
+			o_ptLines->lu32Att[iNum - 4] = lOffset;
+			break;
+		}
+		iNum++;
+
+		if (*pcEnd == ',')
+			pcEnd++;
+		else if (*pcEnd)
+			return -1;
+		pcPos = pcEnd;
+	}
+	if (iNum < 5)
+		return -1;
+	*o_piPadsNum = iNum - 4;
 
-	PSXPads_Command(ptPSXPads, u8PadNo, PSX_CMD_ENTER_CFG, ptPSXPads->ltPad[u8PadNo].lu8Response, sizeof(PSX_CMD_ENTER_CFG));
-	PSXPads_Command(ptPSXPads, u8PadNo, ptPSXPads->ltPad[u8PadNo].lu8EnableMotor, ptPSXPads->ltPad[u8PadNo].lu8Response, sizeof(PSX_CMD_ENABLE_MOTOR));
-	PSXPads_Command(ptPSXPads, u8PadNo, PSX_CMD_EXIT_CFG, ptPSXPads->ltPad[u8PadNo].lu8Response, sizeof(PSX_CMD_EXIT_CFG));
+	return 0;
 }
 
-void PSXPads_SetMotorLevel(struct PSXPads *ptPSXPads, const uint8_t u8PadNo, const uint8_t i_u8Motor1Level, const uint8_t i_u8Motor2Level)
+static void print_usage(const char prog[])
 {
-	if (!ptPSXPads)
-		return;
-	if (u8PadNo >= ptPSXPads->u8PadsNum)
-		return;
-
-	ptPSXPads->ltPad[u8PadNo].u8Motor1Level = i_u8Motor1Level ? 0xFF : 0x00;
-	ptPSXPads->ltPad[u8PadNo].u8Motor2Level = i_u8Motor2Level;
-
-	ptPSXPads->ltPad[u8PadNo].lu8PoolCmd[3] = ptPSXPads->ltPad[u8PadNo].u8Motor1Level;
-	ptPSXPads->ltPad[u8PadNo].lu8PoolCmd[4] = ptPSXPads->ltPad[u8PadNo].u8Motor2Level;
+	printf("Usage: %s [-DGnpcisrRFPv]\n", prog);
+	puts("  -D --device   device to use (default /dev/spidev0.0)\n"
+	     "  -G --gpio     bit-bang GPIO lines instead, CHIP:DAT,CMD,CLK,ACK,ATT[,ATT...]\n"
+	     "                e.g. /dev/gpiochip0:9,10,11,-1,8,7 (ACK -1 unused, one ATT per pad)\n"
+	     "  -n --pads     number of pads, one chip select and spidev device each,\n"
+	     "                -D and the next chip selects on its bus (default 1)\n"
+	     "  -p --priority SCHED_FIFO priority, 0 keeps SCHED_OTHER (default 50)\n"
+	     "  -c --cpus     CPU list to run on, e.g. 0,2-3\n"
+	     "  -i --idle     idle timeout in ms before polling slows down, 0 never\n"
+	     "  -s --shm      also publish the pads in this shared memory segment, e.g. /psxpad\n"
+	     "  -r --record   append the raw frames of every poll to this trace\n"
+	     "  -R --replay   poll the pads from this trace instead of the device\n"
+	     "  -F --fast     replay as fast as possible, not at the recorded pace\n"
+	     "  -P --pressure DualShock 2 pressure buttons as axes, 12 more bytes per poll\n"
+	     "  -v --verbose  print every changed frame\n");
+	exit(1);
 }
 
-void PSXPads_GetKeyState(struct PSXPads *ptPSXPads, const uint8_t u8PadNo, struct PSXPad_KeyState *o_ptKeyState)
+int main(int argc, char *argv[])
 {
-	if (!ptPSXPads)
-		return;
-	if (u8PadNo >= ptPSXPads->u8PadsNum)
-		return;
-	if (!o_ptKeyState)
-		return;
-
-	o_ptKeyState->vType = PSXPAD_KEYSTATE_TYPE_UNKNOWN;
-
-	switch (ptPSXPads->ltPad[u8PadNo].lu8Response[1]) {
-	case 0x79:
-		o_ptKeyState->vType = PSXPAD_KEYSTATE_TYPE_ANALOG2;
-		o_ptKeyState->u8AR   = ptPSXPads->ltPad[u8PadNo].lu8Response[9];
-		o_ptKeyState->u8AL   = ptPSXPads->ltPad[u8PadNo].lu8Response[10];
-		o_ptKeyState->u8AU   = ptPSXPads->ltPad[u8PadNo].lu8Response[11];
-		o_ptKeyState->u8AD   = ptPSXPads->ltPad[u8PadNo].lu8Response[12];
-		o_ptKeyState->u8ATri = ptPSXPads->ltPad[u8PadNo].lu8Response[13];
-		o_ptKeyState->u8ACir = ptPSXPads->ltPad[u8PadNo].lu8Response[14];
-		o_ptKeyState->u8ACrs = ptPSXPads->ltPad[u8PadNo].lu8Response[15];
-		o_ptKeyState->u8ASqr = ptPSXPads->ltPad[u8PadNo].lu8Response[16];
-		o_ptKeyState->u8AL1  = ptPSXPads->ltPad[u8PadNo].lu8Response[17];
-		o_ptKeyState->u8AR1  = ptPSXPads->ltPad[u8PadNo].lu8Response[18];
-		o_ptKeyState->u8AL2  = ptPSXPads->ltPad[u8PadNo].lu8Response[19];
-		o_ptKeyState->u8AR2  = ptPSXPads->ltPad[u8PadNo].lu8Response[20];
-	case 0x73:
-		if (o_ptKeyState->vType == PSXPAD_KEYSTATE_TYPE_UNKNOWN)
-			o_ptKeyState->vType = PSXPAD_KEYSTATE_TYPE_ANALOG1;
-		o_ptKeyState->u8RX = ptPSXPads->ltPad[u8PadNo].lu8Response[5];
-		o_ptKeyState->u8RY = ptPSXPads->ltPad[u8PadNo].lu8Response[6];
-		o_ptKeyState->u8LX = ptPSXPads->ltPad[u8PadNo].lu8Response[7];
-		o_ptKeyState->u8LY = ptPSXPads->ltPad[u8PadNo].lu8Response[8];
-		o_ptKeyState->bL3  = (ptPSXPads->ltPad[u8PadNo].lu8Response[3] & 0x02U) ? 0 : 1;
-		o_ptKeyState->bR3  = (ptPSXPads->ltPad[u8PadNo].lu8Response[3] & 0x04U) ? 0 : 1;
-	case 0x41:
-		if (o_ptKeyState->vType == PSXPAD_KEYSTATE_TYPE_UNKNOWN)
-			o_ptKeyState->vType = PSXPAD_KEYSTATE_TYPE_DIGITAL;
-		o_ptKeyState->bSel = (ptPSXPads->ltPad[u8PadNo].lu8Response[3] & 0x01U) ? 0 : 1;
-		o_ptKeyState->bStt = (ptPSXPads->ltPad[u8PadNo].lu8Response[3] & 0x08U) ? 0 : 1;
-		o_ptKeyState->bU   = (ptPSXPads->ltPad[u8PadNo].lu8Response[3] & 0x10U) ? 0 : 1;
-		o_ptKeyState->bR   = (ptPSXPads->ltPad[u8PadNo].lu8Response[3] & 0x20U) ? 0 : 1;
-		o_ptKeyState->bD   = (ptPSXPads->ltPad[u8PadNo].lu8Response[3] & 0x40U) ? 0 : 1;
-		o_ptKeyState->bL   = (ptPSXPads->ltPad[u8PadNo].lu8Response[3] & 0x80U) ? 0 : 1;
-		o_ptKeyState->bL2  = (ptPSXPads->ltPad[u8PadNo].lu8Response[4] & 0x01U) ? 0 : 1;
-		o_ptKeyState->bR2  = (ptPSXPads->ltPad[u8PadNo].lu8Response[4] & 0x02U) ? 0 : 1;
-		o_ptKeyState->bL1  = (ptPSXPads->ltPad[u8PadNo].lu8Response[4] & 0x04U) ? 0 : 1;
-		o_ptKeyState->bR1  = (ptPSXPads->ltPad[u8PadNo].lu8Response[4] & 0x08U) ? 0 : 1;
-		o_ptKeyState->bTri = (ptPSXPads->ltPad[u8PadNo].lu8Response[4] & 0x10U) ? 0 : 1;
-		o_ptKeyState->bCir = (ptPSXPads->ltPad[u8PadNo].lu8Response[4] & 0x20U) ? 0 : 1;
-		o_ptKeyState->bCrs = (ptPSXPads->ltPad[u8PadNo].lu8Response[4] & 0x40U) ? 0 : 1;
-		o_ptKeyState->bSqr = (ptPSXPads->ltPad[u8PadNo].lu8Response[4] & 0x80U) ? 0 : 1;
+	static const struct option ltOption[] = {
+		{"device",   1, 0, 'D'},
+		{"gpio",     1, 0, 'G'},
+		{"pads",     1, 0, 'n'},
+		{"priority", 1, 0, 'p'},
+		{"cpus",     1, 0, 'c'},
+		{"idle",     1, 0, 'i'},
+		{"shm",      1, 0, 's'},
+		{"record",   1, 0, 'r'},
+		{"replay",   1, 0, 'R'},
+		{"fast",     0, 0, 'F'},
+		{"pressure", 0, 0, 'P'},
+		{"verbose",  0, 0, 'v'},
+		{NULL,       0, 0, 0}
+	};
+	const char *strDevice = device;
+	const char *strCPUs = NULL;
+	const char *strShm = NULL;
+	const char *strRecord = NULL;
+	const char *strReplay = NULL;
+	char *strGPIO = NULL;
+	struct PSXPadGPIO_Lines tLines;
+	const uint8_t *pu8Frame;
+	struct sched_param tParam;
+	cpu_set_t tCPUs;
+	long lIdleTimeoutMs = -1;
+	int iPadsNum = 1, iPriority = 50;
+	uint8_t bRealTime = 1;
+	uint8_t u8PadNo, u8Port;
+	int c, ret = 0;
+
+	while ((c = getopt_long(argc, argv, "D:G:n:p:c:i:s:r:R:FPv", ltOption, NULL)) != -1) {
+		switch (c) {
+		case 'D':
+			strDevice = optarg;
+			break;
+		case 'G':
+			strGPIO = optarg;
+			break;
+		case 'n':
+			iPadsNum = atoi(optarg);
+			break;
+		case 'p':
+			iPriority = atoi(optarg);
+			break;
+		case 'c':
+			strCPUs = optarg;
+			break;
+		case 'i':
+			lIdleTimeoutMs = atol(optarg);
+			break;
+		case 's':
+			strShm = optarg;
+			break;
+		case 'r':
+			strRecord = optarg;
+			break;
+		case 'R':
+			strReplay = optarg;
+			break;
+		case 'F':
+			bRealTime = 0;
+			break;
+		case 'P':
+			bPressure = 1;
+			break;
+		case 'v':
+			bVerbose = 1;
+			break;
+		default:
+			print_usage(argv[0]);
+			break;
+		}
+	}
+	if (iPadsNum < 1 || iPadsNum > PSXPAD_MAXPADNUM)
+		print_usage(argv[0]);
+	if (strCPUs && PSXPad_ParseCPUs(strCPUs, &tCPUs) < 0)
+		print_usage(argv[0]);
+	if (strGPIO && PSXPad_ParseGPIO(strGPIO, &tLines, &iPadsNum) < 0)
+		print_usage(argv[0]);
+
+	if (strReplay) {
+		ptPSXPads = PSXPads_InitReplay(strReplay, bRealTime);
+		if (!ptPSXPads)
+			pabort("can't open trace");
+		iPadsNum = PSXPads_GetPadsNum(ptPSXPads);
+		bReplay = 1;
+	} else if (strGPIO) {
+		ptPSXPads = PSXPads_InitGPIO(strGPIO, &tLines, iPadsNum, 0);
+		if (!ptPSXPads)
+			pabort("can't init GPIO lines");
+	} else {
+		ptPSXPads = PSXPads_Init(strDevice, iPadsNum);
+		if (!ptPSXPads)
+			pabort("can't init pad");
+	}
+	if (strRecord && PSXPads_SetRecord(ptPSXPads, strRecord) < 0)
+		pabort("can't create trace");
+	if (lIdleTimeoutMs >= 0)
+		PSXPads_SetIdleTimeout(ptPSXPads, lIdleTimeoutMs);
+	if (strShm) {
+		ptShm = PSXPadShm_Create(strShm, 0);
+		if (!ptShm)
+			pabort("can't create shared memory");
 	}
-}
-
-int main(void)
-{
-	int ret = 0;
-
-	PSXPads_Init(&tPSXPads, device, 1);
-	PSXPads_SetADMode(&tPSXPads, 0, 1, 1);
-
-	while (1) {
-		int i;
 
-		PSXPads_Pool(&tPSXPads);
-		PSXPads_GetKeyState(&tPSXPads, 0, &tPSXKeyState);
+	for (u8PadNo = 0; u8PadNo < PSXPAD_MAXPADNUM; u8PadNo++)
+		for (u8Port = 0; u8Port < PSXPAD_TAP_PORTS; u8Port++)
+			ltUInput[u8PadNo][u8Port].iFD = -1;
+
+	/* the same device names as psxpad-spi, so mappings made for it apply */
+	for (u8PadNo = 0; u8PadNo < iPadsNum && !bReplay; u8PadNo++) {
+		if (PSXPads_DetectMultitap(ptPSXPads, u8PadNo) < 0)
+			pabort("can't detect multitap");
+		pu8Frame = PSXPads_GetFrame(ptPSXPads, u8PadNo, NULL);
+		if (pu8Frame[1] == 0x80 && pu8Frame[2] == 0x5A) {
+			for (u8Port = 0; u8Port < PSXPAD_TAP_PORTS; u8Port++)
+				if (PSXPad_UInputOpen(&ltUInput[u8PadNo][u8Port], "PlayStation 1/2 joypad (multitap)", bPressure && u8Port == 0) < 0)
+					pabort("can't create uinput device");
+		} else {
+			if (PSXPad_UInputOpen(&ltUInput[u8PadNo][0], "PlayStation 1/2 joypad", bPressure) < 0)
+				pabort("can't create uinput device");
+		}
+	}
 
-		for (i = 0; i < 21; i++)
-			printf("%02X ", tPSXPads.ltPad[0].lu8Response[i]);
-		printf("\n");
-/*
-		if (tPSXKeyState.bU)
-			printf("U ");
-		if (tPSXKeyState.bD)
-			printf("D ");
-		if (tPSXKeyState.bL)
-			printf("L ");
-		if (tPSXKeyState.bR)
-			printf("R ");
-		if (tPSXKeyState.bTri)
-			printf("Tri ");
-		if (tPSXKeyState.bSqr)
-			printf("Sqr ");
-		if (tPSXKeyState.bCrs)
-			printf("Crs ");
-		if (tPSXKeyState.bCir)
-			printf("Cir ");
-		if (tPSXKeyState.bL1)
-			printf("L1 ");
-		if (tPSXKeyState.bR1)
-			printf("R1 ");
-		if (tPSXKeyState.bL2)
-			printf("L2 ");
-		if (tPSXKeyState.bR2)
-			printf("R2 ");
-		if (tPSXKeyState.bSel)
-			printf("Sel ");
-		if (tPSXKeyState.bStt)
-			printf("Stt ");
-		if (tPSXKeyState.bL3)
-			printf("L3 ");
-		if (tPSXKeyState.bR3)
-			printf("R3 ");
-		printf("\n");
-*/
-		usleep(16666);
+	/* another task's load or a page fault would be latency the kernel driver doesn't have */
+	if (strCPUs && sched_setaffinity(0, sizeof(tCPUs), &tCPUs) < 0)
+		perror("can't set CPU affinity");
+	if (iPriority > 0) {
+		memset(&tParam, 0, sizeof(tParam));
+		tParam.sched_priority = iPriority;
+		if (sched_setscheduler(0, SCHED_FIFO, &tParam) < 0)
+			perror("can't set SCHED_FIFO");
+		if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+			perror("can't lock memory");
 	}
 
-	PSXPads_Uninit(&tPSXPads);
+	signal(SIGINT, sigstop);
+	signal(SIGTERM, sigstop);
+	PSXPads_SetCallback(ptPSXPads, changed, NULL);
+	ret = PSXPad_Run();
+	if (ret < 0)
+		perror("can't poll pad");
+
+	for (u8PadNo = 0; u8PadNo < iPadsNum; u8PadNo++)
+		for (u8Port = 0; u8Port < PSXPAD_TAP_PORTS; u8Port++)
+			PSXPad_UInputClose(&ltUInput[u8PadNo][u8Port]);
+	PSXPadShm_Close(ptShm);
+	PSXPads_Uninit(ptPSXPads);
 
 	return ret;
 }